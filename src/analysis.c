@@ -0,0 +1,353 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "analysis.h"
+#include "arguments.h"
+#include "cpu.h"
+#include "memory.h"
+
+uint8_t analysis_map[0x10000];
+
+struct analysis_block* analysis_blocks;
+int analysis_block_count = 0;
+
+// every address is queued at most once, so the queue never overflows
+uint16_t analysis_queue[0x10000];
+int analysis_queue_length = 0;
+
+uint8_t analysis_length(uint8_t opcode) {
+    switch (cpu_mode(opcode)) {
+        case ADDR_IMP:
+            return 1;
+
+        case ADDR_ABSO:
+        case ADDR_ABSX:
+        case ADDR_ABSY:
+        case ADDR_IND:
+        case ADDR_IAX:
+        case ADDR_ZPR:
+            return 3;
+
+        default:
+            return 2;
+    }
+}
+
+uint16_t analysis_peek16(uint16_t address) {
+    return memory_peek(address) | (uint16_t) memory_peek(address + 1) << 8;
+}
+
+int analysis_in_rom(uint16_t address) {
+    return address >= rom_offset && address < rom_offset + rom_size;
+}
+
+void analysis_enqueue(uint16_t address, uint8_t flags) {
+    if (!(analysis_map[address] & ANALYSIS_BLOCK)) {
+        analysis_queue[analysis_queue_length++] = address;
+    }
+
+    analysis_map[address] |= ANALYSIS_BLOCK | flags;
+}
+
+// the target of an indirect jump is only known when the pointer is in rom
+int analysis_resolve_indirect(uint16_t address, uint16_t* target) {
+    uint16_t pointer = analysis_peek16(address + 1);
+    if (!analysis_in_rom(pointer) || !analysis_in_rom(pointer + 1)) {
+        return 0;
+    }
+
+    analysis_map[pointer] |= ANALYSIS_POINTER;
+    analysis_map[(uint16_t) (pointer + 1)] |= ANALYSIS_POINTER;
+    *target = analysis_peek16(pointer);
+    return 1;
+}
+
+// the branch offset is always the last byte of the instruction
+uint16_t analysis_branch_target(uint16_t next) {
+    return next + (int8_t) memory_peek(next - 1);
+}
+
+// return 1 if the target of the jump at address is known, 0 otherwise
+int analysis_jump_target(uint16_t address, uint8_t opcode, uint16_t* target) {
+    switch (cpu_mode(opcode)) {
+        case ADDR_ABSO:
+            *target = analysis_peek16(address + 1);
+            return 1;
+
+        case ADDR_REL:
+            *target = analysis_branch_target(address + 2);
+            return 1;
+
+        case ADDR_IND:
+            return analysis_resolve_indirect(address, target);
+
+        default:
+            return 0;
+    }
+}
+
+// follow the straight line code at address, queueing every other
+// address control can go to
+void analysis_trace(uint16_t address) {
+    for (;;) {
+        if (analysis_map[address] & ANALYSIS_OPCODE) {
+            // ran into code that was already traced, the paths join here
+            analysis_map[address] |= ANALYSIS_BLOCK;
+            return;
+        }
+
+        if (analysis_map[address] & ANALYSIS_CODE) {
+            // jumping into the middle of an instruction
+            return;
+        }
+
+        uint8_t opcode = memory_peek(address);
+        uint8_t length = analysis_length(opcode);
+        uint8_t flow = cpu_flow(opcode);
+        uint16_t next = address + length;
+        uint16_t target;
+
+        analysis_map[address] |= ANALYSIS_OPCODE;
+        for (int i = 0; i < length; i++) {
+            analysis_map[(uint16_t) (address + i)] |= ANALYSIS_CODE;
+        }
+
+        if (flow == FLOW_BRANCH) {
+            analysis_enqueue(analysis_branch_target(next), 0);
+            analysis_enqueue(next, 0);
+            return;
+        }
+
+        if (flow == FLOW_CALL) {
+            analysis_enqueue(analysis_peek16(address + 1), ANALYSIS_SUBROUTINE);
+            analysis_enqueue(next, 0);
+            return;
+        }
+
+        if (flow == FLOW_JUMP) {
+            if (analysis_jump_target(address, opcode, &target)) {
+                analysis_enqueue(target, 0);
+            }
+
+            return;
+        }
+
+        if (flow == FLOW_RETURN) {
+            return;
+        }
+
+        address = next;
+    }
+}
+
+// the control flow leaving the instruction at address,
+// return the number of successors
+int analysis_successors(uint16_t address, struct analysis_block* block) {
+    uint8_t opcode = memory_peek(address);
+    uint8_t flow = cpu_flow(opcode);
+    uint16_t next = address + analysis_length(opcode);
+    uint16_t target;
+
+    block->calls = 0;
+
+    if (flow == FLOW_BRANCH) {
+        block->successors[0] = analysis_branch_target(next);
+        block->successors[1] = next;
+        return 2;
+    }
+
+    if (flow == FLOW_CALL) {
+        block->successors[0] = next;
+        block->successors[1] = analysis_peek16(address + 1);
+        block->calls = 1;
+        return 2;
+    }
+
+    if (flow == FLOW_JUMP) {
+        if (analysis_jump_target(address, opcode, &target)) {
+            block->successors[0] = target;
+            return 1;
+        }
+
+        return 0;
+    }
+
+    if (flow == FLOW_RETURN) {
+        return 0;
+    }
+
+    block->successors[0] = next;
+    return 1;
+}
+
+int analysis_ends_block(uint16_t address) {
+    return cpu_flow(memory_peek(address)) != FLOW_NEXT;
+}
+
+void analysis_build_blocks(void) {
+    int count = 0;
+    for (int i = 0; i < 0x10000; i++) {
+        if ((analysis_map[i] & (ANALYSIS_OPCODE | ANALYSIS_BLOCK)) == (ANALYSIS_OPCODE | ANALYSIS_BLOCK)) {
+            count++;
+        }
+    }
+
+    free(analysis_blocks);
+    analysis_blocks = malloc(count * sizeof(struct analysis_block));
+    analysis_block_count = 0;
+
+    for (int i = 0; i < 0x10000; i++) {
+        if ((analysis_map[i] & (ANALYSIS_OPCODE | ANALYSIS_BLOCK)) != (ANALYSIS_OPCODE | ANALYSIS_BLOCK)) {
+            continue;
+        }
+
+        struct analysis_block* block = &analysis_blocks[analysis_block_count++];
+        uint16_t address = i;
+
+        for (;;) {
+            uint16_t next = address + analysis_length(memory_peek(address));
+
+            if (analysis_ends_block(address) ||
+                !(analysis_map[next] & ANALYSIS_OPCODE) ||
+                (analysis_map[next] & ANALYSIS_BLOCK)) {
+                break;
+            }
+
+            address = next;
+        }
+
+        block->start = i;
+        block->last = address;
+        block->successor_count = analysis_successors(address, block);
+    }
+}
+
+// walk every instruction reachable from the vectors of the loaded image
+void analysis_run(void) {
+    memset(analysis_map, 0, sizeof(analysis_map));
+    analysis_queue_length = 0;
+
+    analysis_enqueue(analysis_peek16(0xFFFC), ANALYSIS_VECTOR);
+    analysis_enqueue(analysis_peek16(0xFFFE), ANALYSIS_VECTOR);
+    analysis_enqueue(analysis_peek16(0xFFFA), ANALYSIS_VECTOR);
+
+    while (analysis_queue_length) {
+        analysis_trace(analysis_queue[--analysis_queue_length]);
+    }
+
+    analysis_build_blocks();
+}
+
+void analysis_free(void) {
+    free(analysis_blocks);
+    analysis_blocks = NULL;
+    analysis_block_count = 0;
+}
+
+void analysis_export_dot(FILE* file) {
+    fprintf(file, "digraph cfg {\n");
+    fprintf(file, "    node [shape=box, fontname=monospace];\n");
+
+    for (int i = 0; i < analysis_block_count; i++) {
+        struct analysis_block* block = &analysis_blocks[i];
+        uint8_t flags = analysis_map[block->start];
+
+        fprintf(file, "    b%04X [label=\"$%04X-$%04X\"%s];\n", block->start, block->start, block->last,
+                flags & ANALYSIS_VECTOR ? ", peripheries=2" : flags & ANALYSIS_SUBROUTINE ? ", style=rounded" : "");
+
+        for (int j = 0; j < block->successor_count; j++) {
+            fprintf(file, "    b%04X -> b%04X%s;\n", block->start, block->successors[j],
+                    block->calls && j == 1 ? " [style=dashed]" : "");
+        }
+    }
+
+    fprintf(file, "}\n");
+}
+
+void analysis_export_json(FILE* file) {
+    fprintf(file, "{\n  \"vectors\": {\"nmi\": %u, \"reset\": %u, \"irq\": %u},\n",
+            analysis_peek16(0xFFFA), analysis_peek16(0xFFFC), analysis_peek16(0xFFFE));
+    fprintf(file, "  \"blocks\": [");
+
+    for (int i = 0; i < analysis_block_count; i++) {
+        struct analysis_block* block = &analysis_blocks[i];
+
+        fprintf(file, "%s\n    {\"start\": %u, \"last\": %u, \"subroutine\": %s, \"successors\": [",
+                i ? "," : "", block->start, block->last,
+                analysis_map[block->start] & ANALYSIS_SUBROUTINE ? "true" : "false");
+
+        for (int j = 0; j < block->successor_count && !(block->calls && j == 1); j++) {
+            fprintf(file, "%s%u", j ? ", " : "", block->successors[j]);
+        }
+
+        fprintf(file, "]");
+        if (block->calls) {
+            fprintf(file, ", \"calls\": %u", block->successors[1]);
+        }
+
+        fprintf(file, "}");
+    }
+
+    fprintf(file, "\n  ]\n}\n");
+}
+
+// a .json path gets JSON, anything else gets a graphviz graph.
+// return 1 if the export failed, 0 otherwise
+int analysis_export(const char* path) {
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "Could not open %s.\n", path);
+        return 1;
+    }
+
+    size_t length = strlen(path);
+    if (length >= 5 && strcmp(path + length - 5, ".json") == 0) {
+        analysis_export_json(file);
+    } else {
+        analysis_export_dot(file);
+    }
+
+    fclose(file);
+    return 0;
+}
+
+// the closest instruction before address, falling back to
+// the previous byte when nothing before it is known code
+uint16_t analysis_previous(uint16_t address) {
+    for (int i = 1; i <= 3; i++) {
+        uint16_t previous = address - i;
+        if ((analysis_map[previous] & ANALYSIS_OPCODE) && (uint16_t) (previous + analysis_length(memory_peek(previous))) == address) {
+            return previous;
+        }
+    }
+
+    return address - 1;
+}
+
+// return the length of the instruction
+uint8_t analysis_disassemble(uint16_t address, char* buffer, int size) {
+    uint8_t opcode = memory_peek(address);
+    uint8_t operand = memory_peek(address + 1);
+    uint16_t operand16 = analysis_peek16(address + 1);
+    const char* name = cpu_mnemonic(opcode);
+
+    switch (cpu_mode(opcode)) {
+        case ADDR_IMM:  snprintf(buffer, size, "%s #$%02X", name, operand); break;
+        case ADDR_ZP:   snprintf(buffer, size, "%s $%02X", name, operand); break;
+        case ADDR_ZPX:  snprintf(buffer, size, "%s $%02X,X", name, operand); break;
+        case ADDR_ZPY:  snprintf(buffer, size, "%s $%02X,Y", name, operand); break;
+        case ADDR_REL:  snprintf(buffer, size, "%s $%04X", name, (uint16_t) (address + 2 + (int8_t) operand)); break;
+        case ADDR_ABSO: snprintf(buffer, size, "%s $%04X", name, operand16); break;
+        case ADDR_ABSX: snprintf(buffer, size, "%s $%04X,X", name, operand16); break;
+        case ADDR_ABSY: snprintf(buffer, size, "%s $%04X,Y", name, operand16); break;
+        case ADDR_IND:  snprintf(buffer, size, "%s ($%04X)", name, operand16); break;
+        case ADDR_INDX: snprintf(buffer, size, "%s ($%02X,X)", name, operand); break;
+        case ADDR_INDY: snprintf(buffer, size, "%s ($%02X),Y", name, operand); break;
+        case ADDR_IZP:  snprintf(buffer, size, "%s ($%02X)", name, operand); break;
+        case ADDR_IAX:  snprintf(buffer, size, "%s ($%04X,X)", name, operand16); break;
+        case ADDR_ZPR:  snprintf(buffer, size, "%s $%02X,$%04X", name, operand, analysis_branch_target(address + 3)); break;
+        default:        snprintf(buffer, size, "%s", name); break;
+    }
+
+    return analysis_length(opcode);
+}
@@ -0,0 +1,37 @@
+#ifndef CURSES6502_ANALYSIS_H
+#define CURSES6502_ANALYSIS_H
+
+#include <stdint.h>
+
+#define ANALYSIS_CODE (1 << 0)       // part of a reachable instruction
+#define ANALYSIS_OPCODE (1 << 1)     // first byte of a reachable instruction
+#define ANALYSIS_BLOCK (1 << 2)      // a basic block starts here
+#define ANALYSIS_SUBROUTINE (1 << 3) // target of a JSR
+#define ANALYSIS_VECTOR (1 << 4)     // target of the reset, IRQ or NMI vector
+#define ANALYSIS_POINTER (1 << 5)    // data, a resolved jump table entry
+
+#define ANALYSIS_MAX_SUCCESSORS 2
+
+struct analysis_block {
+    uint16_t start;
+    uint16_t last;      // address of the last instruction
+    uint16_t successors[ANALYSIS_MAX_SUCCESSORS];
+    uint8_t successor_count;
+    uint8_t calls;      // the block ends with a JSR to successors[1]
+};
+
+extern uint8_t analysis_map[0x10000];
+
+extern struct analysis_block* analysis_blocks;
+extern int analysis_block_count;
+
+void analysis_run(void);
+void analysis_free(void);
+
+int analysis_export(const char* path);
+
+uint8_t analysis_length(uint8_t opcode);
+uint16_t analysis_previous(uint16_t address);
+uint8_t analysis_disassemble(uint16_t address, char* buffer, int size);
+
+#endif
@@ -1,11 +1,47 @@
 #include <getopt.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "arguments.h"
+#include "console.h"
+#include "mapper.h"
+#include "reload.h"
 
 char* bin_file;             // -i <file>
 int rom_size     = 0x8000;  // -s <size>
 int rom_offset   = 0x8000;  // -o <offset>
+int hot_reload = -1;        // -r <continue|reset>
+
+char* cpu_model = "nmos";   // -C <cpu>
+int exact_bus = 0;          // -E
+long verify_cycles = 0;     // -V <cycles>
+char* waveform_file;        // -v <file>
+
+char* bank_file;            // -B <file>
+int physical_size = 0;      // -P <size>
+char* bank_windows[MAPPER_MAX_WINDOWS]; // -M <start>:<size>:<register>:<offset>[:rom]
+int bank_window_count = 0;
+
+char* heatmap_file;         // -H <file>
+
+char* coverage_file;        // -c <file>
+char* lcov_file;            // -L <file>
+char* listing_file;         // -S <file>
+
+long headless_cycles = 0;   // -x <cycles>
+
+char* sweep_input;          // -w <file>:<address>:<size>
+char* sweep_output;         // -W <file>:<address>:<size>
+
+char* graph_file;           // -g <file>
+
+char* debugger_endpoint;    // -d <port|socket>
+
+int console_address = -1;   // -u <address>
+char* console_output_file;  // -T <file>
+char* console_input_file;   // -X <file>
+
+char* metrics_file;         // -m <file>
 
 void print_usage(const char* app_name) {
     printf("Usage: %s [options]\n", app_name);
@@ -14,6 +50,31 @@ void print_usage(const char* app_name) {
     printf("  -i <file>         The binary file to execute.\n");
     printf("  -R <size>         Set the ROM size. Default: 0x8000\n");
     printf("  -O <offset>       Set the ROM offset. Default: 0x8000\n");
+    printf("  -r <action>       Reload the ROM whenever the binary file changes, keeping the RAM, then continue or reset.\n");
+    printf("  -C <cpu>          The cpu to emulate, nmos (with the undocumented opcodes) or 65c02. Default: nmos\n");
+    printf("  -E                Run the cycle-exact core, every bus access on its own cycle (nmos only).\n");
+    printf("  -V <cycles>       Run the fast and the cycle-exact core side by side for a number of cycles, then exit.\n");
+    printf("  -v <file>         Record the bus of every cycle as a VCD waveform. Needs the cycle-exact core (-E).\n");
+    printf("  -P <size>         Set the size of the banked physical memory. Default: 0\n");
+    printf("  -B <file>         The binary file loaded into the banked physical memory.\n");
+    printf("  -M <window>       Add a bank window, as <start>:<size>:<register>:<offset>[:rom].\n");
+#ifdef CURSES6502_HEATMAP
+    printf("  -H <file>         Export the memory access counters on exit, as CSV if the file ends with .csv.\n");
+#endif
+#ifdef CURSES6502_COVERAGE
+    printf("  -c <file>         Merge the coverage of this run into a raw coverage file.\n");
+    printf("  -L <file>         Write an lcov report of the (merged) coverage.\n");
+    printf("  -S <file>         Map addresses to source lines in the lcov report, one \"<address> <file>:<line>\" per line.\n");
+#endif
+    printf("  -x <cycles>       Run for a number of cycles without the user interface, then exit. -1 runs forever.\n");
+    printf("  -w <table>        Run one machine per table in a file, as <file>:<address>:<size>, for -x cycles each.\n");
+    printf("  -W <table>        Append the memory of every machine of -w to a file afterwards, as <file>:<address>:<size>.\n");
+    printf("  -g <file>         Export the control flow graph, as JSON if the file ends with .json, DOT otherwise.\n");
+    printf("  -d <port|socket>  Serve the remote debugger on a localhost port or a unix socket.\n");
+    printf("  -u <address>      Map the console device at this address.\n");
+    printf("  -T <file>         Where the console output goes. Default: stdout, without the user interface only\n");
+    printf("  -X <file>         Where the console input comes from. Default: stdin, without the user interface only\n");
+    printf("  -m <file>         Publish live counters in a mapped file, /dev/shm/<name> for shared memory. See curses6502-stat.\n");
 }
 
 // return 1 if should abort, 0 otherwise
@@ -23,24 +84,150 @@ int validate_args(void) {
         return 1;
     }
 
+    if (rom_offset < 0 || rom_offset > 0x10000 || rom_size <= 0 || rom_size > 0x10000 - rom_offset) {
+        fprintf(stderr, "The rom region $%X+$%X is outside of the address space.\n", rom_offset, rom_size);
+        return 1;
+    }
+
+    if (console_address != -1 && (console_address < 0 || console_address > 0xffff - CONSOLE_CONTROL)) {
+        fprintf(stderr, "The console at $%X doesn't fit in the address space.\n", console_address);
+        return 1;
+    }
+
+    if (bank_window_count && !physical_size) {
+        fprintf(stderr, "Bank windows need banked physical memory (-P).\n");
+        return 1;
+    }
+
+    if (waveform_file && !exact_bus) {
+        fprintf(stderr, "A waveform needs the cycle-exact core (-E).\n");
+        return 1;
+    }
+
+    if (sweep_input && headless_cycles <= 0) {
+        fprintf(stderr, "A sweep needs a cycle count (-x).\n");
+        return 1;
+    }
+
     return 0;
 }
 
 // return 1 if should abort, 0 otherwise
 int arguments_read(int argc, char** argv) {
     int opt;
-    while ((opt = getopt(argc, argv, "hi:s:o:")) != -1) {
+    while ((opt = getopt(argc, argv, "hi:R:O:r:C:EV:v:P:B:M:H:c:L:S:x:w:W:g:d:u:T:X:m:")) != -1) {
         switch (opt) {
             case 'i':
                 bin_file = optarg;
                 break;
 
             case 'R':
-                rom_size = atoi(optarg);
+                rom_size = strtol(optarg, NULL, 0);
                 break;
 
             case 'O':
-                rom_offset = atoi(optarg);
+                rom_offset = strtol(optarg, NULL, 0);
+                break;
+
+            case 'r':
+                if (strcmp(optarg, "continue") == 0) {
+                    hot_reload = RELOAD_CONTINUE;
+                } else if (strcmp(optarg, "reset") == 0) {
+                    hot_reload = RELOAD_RESET;
+                } else {
+                    fprintf(stderr, "Unknown reload action %s, expected continue or reset.\n", optarg);
+                    return 1;
+                }
+
+                break;
+
+            case 'P':
+                physical_size = strtol(optarg, NULL, 0);
+                break;
+
+            case 'B':
+                bank_file = optarg;
+                break;
+
+            case 'M':
+                if (bank_window_count == MAPPER_MAX_WINDOWS) {
+                    fprintf(stderr, "Too many bank windows.\n");
+                    return 1;
+                }
+
+                bank_windows[bank_window_count++] = optarg;
+                break;
+
+#ifdef CURSES6502_HEATMAP
+            case 'H':
+                heatmap_file = optarg;
+                break;
+#endif
+
+#ifdef CURSES6502_COVERAGE
+            case 'c':
+                coverage_file = optarg;
+                break;
+
+            case 'L':
+                lcov_file = optarg;
+                break;
+
+            case 'S':
+                listing_file = optarg;
+                break;
+#endif
+
+            case 'C':
+                cpu_model = optarg;
+                break;
+
+            case 'E':
+                exact_bus = 1;
+                break;
+
+            case 'V':
+                verify_cycles = strtol(optarg, NULL, 0);
+                break;
+
+            case 'v':
+                waveform_file = optarg;
+                break;
+
+            case 'x':
+                headless_cycles = strtol(optarg, NULL, 0);
+                break;
+
+            case 'w':
+                sweep_input = optarg;
+                break;
+
+            case 'W':
+                sweep_output = optarg;
+                break;
+
+            case 'g':
+                graph_file = optarg;
+                break;
+
+            case 'd':
+                debugger_endpoint = optarg;
+                break;
+
+            case 'u':
+                console_address = strtol(optarg, NULL, 0);
+                break;
+
+            case 'T':
+                console_output_file = optarg;
+                break;
+
+            case 'X':
+                console_input_file = optarg;
+                break;
+
+            case 'm':
+                metrics_file = optarg;
                 break;
 
             case 'h':
@@ -4,6 +4,38 @@
 extern char* bin_file;
 extern int rom_size;
 extern int rom_offset;
+extern int hot_reload;
+
+extern char* cpu_model;
+extern int exact_bus;
+extern long verify_cycles;
+extern char* waveform_file;
+
+extern char* bank_file;
+extern int physical_size;
+extern char* bank_windows[];
+extern int bank_window_count;
+
+extern char* heatmap_file;
+
+extern char* coverage_file;
+extern char* lcov_file;
+extern char* listing_file;
+
+extern long headless_cycles;
+
+extern char* sweep_input;
+extern char* sweep_output;
+
+extern char* graph_file;
+
+extern char* debugger_endpoint;
+
+extern int console_address;
+extern char* console_output_file;
+extern char* console_input_file;
+
+extern char* metrics_file;
 
 int arguments_read(int argc, char** argv);
 
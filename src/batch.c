@@ -0,0 +1,1210 @@
+#include <stdlib.h>
+#include <string.h>
+#include "batch.h"
+#include "cpu.h"
+#include "memory.h"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// one byte per lane, a whole register of lanes at a time. without SSE2
+// the vector is a single lane and the kernels go through them one by one
+#if defined(__AVX2__)
+#define BATCH_WIDTH 32
+typedef __m256i batch_vector;
+
+#define VLOAD(p)       _mm256_load_si256((const __m256i*) (p))
+#define VSTORE(p, v)   _mm256_store_si256((__m256i*) (p), v)
+#define VSET(b)        _mm256_set1_epi8((char) (b))
+#define VAND(l, r)     _mm256_and_si256(l, r)
+#define VOR(l, r)      _mm256_or_si256(l, r)
+#define VXOR(l, r)     _mm256_xor_si256(l, r)
+#define VANDNOT(l, r)  _mm256_andnot_si256(l, r)
+#define VADD(l, r)     _mm256_add_epi8(l, r)
+#define VSUB(l, r)     _mm256_sub_epi8(l, r)
+#define VADDS(l, r)    _mm256_adds_epu8(l, r)
+#define VMAX(l, r)     _mm256_max_epu8(l, r)
+#define VEQ(l, r)      _mm256_cmpeq_epi8(l, r)
+#define VSHR(v)        _mm256_and_si256(_mm256_srli_epi16(v, 1), _mm256_set1_epi8(0x7f))
+#define VANY(v)        _mm256_movemask_epi8(v)
+#elif defined(__SSE2__)
+#define BATCH_WIDTH 16
+typedef __m128i batch_vector;
+
+#define VLOAD(p)       _mm_load_si128((const __m128i*) (p))
+#define VSTORE(p, v)   _mm_store_si128((__m128i*) (p), v)
+#define VSET(b)        _mm_set1_epi8((char) (b))
+#define VAND(l, r)     _mm_and_si128(l, r)
+#define VOR(l, r)      _mm_or_si128(l, r)
+#define VXOR(l, r)     _mm_xor_si128(l, r)
+#define VANDNOT(l, r)  _mm_andnot_si128(l, r)
+#define VADD(l, r)     _mm_add_epi8(l, r)
+#define VSUB(l, r)     _mm_sub_epi8(l, r)
+#define VADDS(l, r)    _mm_adds_epu8(l, r)
+#define VMAX(l, r)     _mm_max_epu8(l, r)
+#define VEQ(l, r)      _mm_cmpeq_epi8(l, r)
+#define VSHR(v)        _mm_and_si128(_mm_srli_epi16(v, 1), _mm_set1_epi8(0x7f))
+#define VANY(v)        _mm_movemask_epi8(v)
+#else
+#define BATCH_WIDTH 1
+typedef uint8_t batch_vector;
+
+#define VLOAD(p)       (*(p))
+#define VSTORE(p, v)   (*(p) = (v))
+#define VSET(b)        ((uint8_t) (b))
+#define VAND(l, r)     ((uint8_t) ((l) & (r)))
+#define VOR(l, r)      ((uint8_t) ((l) | (r)))
+#define VXOR(l, r)     ((uint8_t) ((l) ^ (r)))
+#define VANDNOT(l, r)  ((uint8_t) (~(l) & (r)))
+#define VADD(l, r)     ((uint8_t) ((l) + (r)))
+#define VSUB(l, r)     ((uint8_t) ((l) - (r)))
+#define VADDS(l, r)    ((uint8_t) ((l) + (r) > 0xff ? 0xff : (l) + (r)))
+#define VMAX(l, r)     ((l) > (r) ? (l) : (r))
+#define VEQ(l, r)      ((uint8_t) ((l) == (r) ? 0xff : 0))
+#define VSHR(v)        ((uint8_t) ((v) >> 1))
+#define VANY(v)        (v)
+#endif
+
+// the arrays are padded to whole AVX2 registers whatever the build uses
+#define BATCH_ALIGN 32
+
+// groups smaller than this fraction of the running lanes
+// aren't worth a pass over every lane, they run on the fast core
+#define BATCH_PEEL 16
+
+#define KIND_SCALAR  0 // stepped lane by lane on the fast core
+#define KIND_IMPLIED 1
+#define KIND_READ    2
+#define KIND_WRITE   3
+#define KIND_MODIFY  4
+#define KIND_BRANCH  5
+#define KIND_JUMP    6
+#define KIND_CALL    7
+#define KIND_RETURN  8
+#define KIND_PUSH    9
+#define KIND_PULL    10
+
+// the registers of a vector of lanes, and the operand of the instruction
+struct batch_chunk {
+    batch_vector a;
+    batch_vector x;
+    batch_vector y;
+    batch_vector sp;
+    batch_vector status;
+    batch_vector value;
+};
+
+// the lanes stepped together, see batch_gather. the cycles every member
+// ran go to elapsed and are only added to their counters when the group
+// breaks up, slack is how many of them it can run before one of its
+// members is out of cycles
+struct batch_group {
+    int count;
+    uint16_t pc;
+    uint32_t next; // the lowest pc of the lanes waiting ahead
+    uint64_t elapsed;
+    uint64_t slack;
+    int shared; // whether the members share the pages of the instruction at pc
+};
+
+// memory_remaps + 1 when the lanes were last compared on a page, and
+// whether they all had it at the same storage then
+static uint64_t batch_compared[MEMORY_PAGE_COUNT];
+static uint8_t batch_uniform_pages[MEMORY_PAGE_COUNT];
+
+// set when a lane took the slow path of a write, which may have given it
+// a copy of its own of the pages the group runs from
+static int batch_faulted;
+
+// built from the mnemonics of the fast core by batch_create
+static void (*operations[256])(struct batch_chunk*);
+static uint8_t kinds[256];
+static uint8_t modes[256];
+
+// clear flag in status, then set it in the lanes where condition is $FF
+static batch_vector setflag(batch_vector status, uint8_t flag, batch_vector condition) {
+    return VOR(VANDNOT(VSET(flag), status), VAND(condition, VSET(flag)));
+}
+
+// $FF in the lanes where bit is set in v
+static batch_vector isset(batch_vector v, uint8_t bit) {
+    return VEQ(VAND(v, VSET(bit)), VSET(bit));
+}
+
+static batch_vector setnz(batch_vector status, batch_vector result) {
+    status = setflag(status, FLAG_ZERO, VEQ(result, VSET(0)));
+    return VOR(VANDNOT(VSET(FLAG_NEGATIVE), status), VAND(result, VSET(FLAG_NEGATIVE)));
+}
+
+static batch_vector compare(batch_vector status, batch_vector reg, batch_vector operand) {
+    status = setflag(status, FLAG_CARRY, VEQ(VMAX(reg, operand), reg));
+    return setnz(status, VSUB(reg, operand));
+}
+
+// a + operand + carry, without 16 bit lanes: the carry out is either
+// from a + operand, which saturates to $FF without wrapping to it,
+// or from adding the carry in to a sum of $FF
+static void add(struct batch_chunk* c, batch_vector operand) {
+    batch_vector carry = VAND(c->status, VSET(FLAG_CARRY));
+    batch_vector sum = VADD(c->a, operand);
+    batch_vector result = VADD(sum, carry);
+
+    batch_vector full = VEQ(sum, VSET(0xff));
+    batch_vector out = VOR(VANDNOT(full, VEQ(VADDS(c->a, operand), VSET(0xff))), VAND(full, VEQ(carry, VSET(1))));
+    batch_vector overflow = isset(VANDNOT(VXOR(c->a, operand), VXOR(c->a, result)), 0x80);
+
+    c->status = setflag(setflag(c->status, FLAG_CARRY, out), FLAG_OVERFLOW, overflow);
+    c->status = setnz(c->status, result);
+    c->a = result;
+}
+
+static void adc(struct batch_chunk* c) {
+    add(c, c->value);
+}
+
+static void sbc(struct batch_chunk* c) {
+    add(c, VXOR(c->value, VSET(0xff)));
+}
+
+static void and(struct batch_chunk* c) {
+    c->a = VAND(c->a, c->value);
+    c->status = setnz(c->status, c->a);
+}
+
+static void ora(struct batch_chunk* c) {
+    c->a = VOR(c->a, c->value);
+    c->status = setnz(c->status, c->a);
+}
+
+static void eor(struct batch_chunk* c) {
+    c->a = VXOR(c->a, c->value);
+    c->status = setnz(c->status, c->a);
+}
+
+static void lda(struct batch_chunk* c) {
+    c->a = c->value;
+    c->status = setnz(c->status, c->a);
+}
+
+static void ldx(struct batch_chunk* c) {
+    c->x = c->value;
+    c->status = setnz(c->status, c->x);
+}
+
+static void ldy(struct batch_chunk* c) {
+    c->y = c->value;
+    c->status = setnz(c->status, c->y);
+}
+
+static void lax(struct batch_chunk* c) {
+    c->a = c->value;
+    c->x = c->value;
+    c->status = setnz(c->status, c->a);
+}
+
+static void nop(struct batch_chunk* c) {
+    (void) c;
+}
+
+static void bit(struct batch_chunk* c) {
+    c->status = setflag(c->status, FLAG_ZERO, VEQ(VAND(c->a, c->value), VSET(0)));
+    c->status = VOR(VANDNOT(VSET(FLAG_NEGATIVE | FLAG_OVERFLOW), c->status),
+                    VAND(c->value, VSET(FLAG_NEGATIVE | FLAG_OVERFLOW)));
+}
+
+// the 65C02 BIT #imm only sets the zero flag
+static void bit_imm(struct batch_chunk* c) {
+    c->status = setflag(c->status, FLAG_ZERO, VEQ(VAND(c->a, c->value), VSET(0)));
+}
+
+static void cmp(struct batch_chunk* c) {
+    c->status = compare(c->status, c->a, c->value);
+}
+
+static void cpx(struct batch_chunk* c) {
+    c->status = compare(c->status, c->x, c->value);
+}
+
+static void cpy(struct batch_chunk* c) {
+    c->status = compare(c->status, c->y, c->value);
+}
+
+static void sta(struct batch_chunk* c) {
+    c->value = c->a;
+}
+
+static void stx(struct batch_chunk* c) {
+    c->value = c->x;
+}
+
+static void sty(struct batch_chunk* c) {
+    c->value = c->y;
+}
+
+static void stz(struct batch_chunk* c) {
+    c->value = VSET(0);
+}
+
+static void sax(struct batch_chunk* c) {
+    c->value = VAND(c->a, c->x);
+}
+
+static void asl(struct batch_chunk* c) {
+    c->status = setflag(c->status, FLAG_CARRY, isset(c->value, 0x80));
+    c->value = VADD(c->value, c->value);
+    c->status = setnz(c->status, c->value);
+}
+
+static void lsr(struct batch_chunk* c) {
+    c->status = setflag(c->status, FLAG_CARRY, isset(c->value, 0x01));
+    c->value = VSHR(c->value);
+    c->status = setnz(c->status, c->value);
+}
+
+static void rol(struct batch_chunk* c) {
+    batch_vector carry = VAND(c->status, VSET(FLAG_CARRY));
+
+    c->status = setflag(c->status, FLAG_CARRY, isset(c->value, 0x80));
+    c->value = VOR(VADD(c->value, c->value), carry);
+    c->status = setnz(c->status, c->value);
+}
+
+static void ror(struct batch_chunk* c) {
+    batch_vector carry = VAND(isset(c->status, FLAG_CARRY), VSET(0x80));
+
+    c->status = setflag(c->status, FLAG_CARRY, isset(c->value, 0x01));
+    c->value = VOR(VSHR(c->value), carry);
+    c->status = setnz(c->status, c->value);
+}
+
+static void inc(struct batch_chunk* c) {
+    c->value = VADD(c->value, VSET(1));
+    c->status = setnz(c->status, c->value);
+}
+
+static void dec(struct batch_chunk* c) {
+    c->value = VSUB(c->value, VSET(1));
+    c->status = setnz(c->status, c->value);
+}
+
+static void tax(struct batch_chunk* c) {
+    c->x = c->a;
+    c->status = setnz(c->status, c->x);
+}
+
+static void tay(struct batch_chunk* c) {
+    c->y = c->a;
+    c->status = setnz(c->status, c->y);
+}
+
+static void txa(struct batch_chunk* c) {
+    c->a = c->x;
+    c->status = setnz(c->status, c->a);
+}
+
+static void tya(struct batch_chunk* c) {
+    c->a = c->y;
+    c->status = setnz(c->status, c->a);
+}
+
+static void tsx(struct batch_chunk* c) {
+    c->x = c->sp;
+    c->status = setnz(c->status, c->x);
+}
+
+static void txs(struct batch_chunk* c) {
+    c->sp = c->x;
+}
+
+static void inx(struct batch_chunk* c) {
+    c->x = VADD(c->x, VSET(1));
+    c->status = setnz(c->status, c->x);
+}
+
+static void iny(struct batch_chunk* c) {
+    c->y = VADD(c->y, VSET(1));
+    c->status = setnz(c->status, c->y);
+}
+
+static void dex(struct batch_chunk* c) {
+    c->x = VSUB(c->x, VSET(1));
+    c->status = setnz(c->status, c->x);
+}
+
+static void dey(struct batch_chunk* c) {
+    c->y = VSUB(c->y, VSET(1));
+    c->status = setnz(c->status, c->y);
+}
+
+static void clc(struct batch_chunk* c) {
+    c->status = VANDNOT(VSET(FLAG_CARRY), c->status);
+}
+
+static void cld(struct batch_chunk* c) {
+    c->status = VANDNOT(VSET(FLAG_DECIMAL), c->status);
+}
+
+static void cli(struct batch_chunk* c) {
+    c->status = VANDNOT(VSET(FLAG_INTERRUPT), c->status);
+}
+
+static void clv(struct batch_chunk* c) {
+    c->status = VANDNOT(VSET(FLAG_OVERFLOW), c->status);
+}
+
+static void sec(struct batch_chunk* c) {
+    c->status = VOR(c->status, VSET(FLAG_CARRY));
+}
+
+static void sed(struct batch_chunk* c) {
+    c->status = VOR(c->status, VSET(FLAG_DECIMAL));
+}
+
+static void sei(struct batch_chunk* c) {
+    c->status = VOR(c->status, VSET(FLAG_INTERRUPT));
+}
+
+// the branches leave $FF in value for the lanes taking them
+static void bcc(struct batch_chunk* c) {
+    c->value = VEQ(VAND(c->status, VSET(FLAG_CARRY)), VSET(0));
+}
+
+static void bcs(struct batch_chunk* c) {
+    c->value = isset(c->status, FLAG_CARRY);
+}
+
+static void beq(struct batch_chunk* c) {
+    c->value = isset(c->status, FLAG_ZERO);
+}
+
+static void bne(struct batch_chunk* c) {
+    c->value = VEQ(VAND(c->status, VSET(FLAG_ZERO)), VSET(0));
+}
+
+static void bmi(struct batch_chunk* c) {
+    c->value = isset(c->status, FLAG_NEGATIVE);
+}
+
+static void bpl(struct batch_chunk* c) {
+    c->value = VEQ(VAND(c->status, VSET(FLAG_NEGATIVE)), VSET(0));
+}
+
+static void bvc(struct batch_chunk* c) {
+    c->value = VEQ(VAND(c->status, VSET(FLAG_OVERFLOW)), VSET(0));
+}
+
+static void bvs(struct batch_chunk* c) {
+    c->value = isset(c->status, FLAG_OVERFLOW);
+}
+
+static void bra(struct batch_chunk* c) {
+    c->value = VSET(0xff);
+}
+
+// everything not in here, the other stack instructions, the interrupts
+// and the undocumented instructions with unstable results, runs on the
+// fast core a lane at a time. ADC and SBC are binary with the decimal
+// flag set too, the way both cores run them
+static const struct {
+    const char* name;
+    uint8_t kind;
+    void (*operation)(struct batch_chunk*);
+} instructions[] = {
+        {"ADC", KIND_READ, adc}, {"AND", KIND_READ, and}, {"BIT", KIND_READ, bit}, {"CMP", KIND_READ, cmp},
+        {"CPX", KIND_READ, cpx}, {"CPY", KIND_READ, cpy}, {"EOR", KIND_READ, eor}, {"LDA", KIND_READ, lda},
+        {"LDX", KIND_READ, ldx}, {"LDY", KIND_READ, ldy}, {"NOP", KIND_READ, nop}, {"ORA", KIND_READ, ora},
+        {"SBC", KIND_READ, sbc}, {"LAX", KIND_READ, lax},
+
+        {"STA", KIND_WRITE, sta}, {"STX", KIND_WRITE, stx}, {"STY", KIND_WRITE, sty}, {"STZ", KIND_WRITE, stz},
+        {"SAX", KIND_WRITE, sax},
+
+        {"ASL", KIND_MODIFY, asl}, {"DEC", KIND_MODIFY, dec}, {"INC", KIND_MODIFY, inc}, {"LSR", KIND_MODIFY, lsr},
+        {"ROL", KIND_MODIFY, rol}, {"ROR", KIND_MODIFY, ror},
+
+        {"CLC", KIND_IMPLIED, clc}, {"CLD", KIND_IMPLIED, cld}, {"CLI", KIND_IMPLIED, cli}, {"CLV", KIND_IMPLIED, clv},
+        {"DEX", KIND_IMPLIED, dex}, {"DEY", KIND_IMPLIED, dey}, {"INX", KIND_IMPLIED, inx}, {"INY", KIND_IMPLIED, iny},
+        {"SEC", KIND_IMPLIED, sec}, {"SED", KIND_IMPLIED, sed}, {"SEI", KIND_IMPLIED, sei}, {"TAX", KIND_IMPLIED, tax},
+        {"TAY", KIND_IMPLIED, tay}, {"TSX", KIND_IMPLIED, tsx}, {"TXA", KIND_IMPLIED, txa}, {"TXS", KIND_IMPLIED, txs},
+        {"TYA", KIND_IMPLIED, tya},
+
+        {"BCC", KIND_BRANCH, bcc}, {"BCS", KIND_BRANCH, bcs}, {"BEQ", KIND_BRANCH, beq}, {"BMI", KIND_BRANCH, bmi},
+        {"BNE", KIND_BRANCH, bne}, {"BPL", KIND_BRANCH, bpl}, {"BVC", KIND_BRANCH, bvc}, {"BVS", KIND_BRANCH, bvs},
+        {"BRA", KIND_BRANCH, bra},
+
+        {"JMP", KIND_JUMP, NULL}, {"JSR", KIND_CALL, NULL}, {"RTS", KIND_RETURN, NULL}, {"PHA", KIND_PUSH, NULL},
+        {"PLA", KIND_PULL, lda},
+};
+
+// whether the lanes can run an instruction of kind in mode together
+static int batch_vectorizable(uint8_t kind, uint8_t mode) {
+    switch (kind) {
+        case KIND_IMPLIED:
+        case KIND_RETURN:
+        case KIND_PUSH:
+        case KIND_PULL:
+            return mode == ADDR_IMP;
+
+        case KIND_BRANCH:
+            return mode == ADDR_REL;
+
+        case KIND_JUMP:
+        case KIND_CALL:
+            return mode == ADDR_ABSO;
+
+        default:
+            switch (mode) {
+                case ADDR_IMP:
+                    return kind != KIND_WRITE;
+
+                case ADDR_IMM:
+                    return kind == KIND_READ;
+
+                case ADDR_ZP:
+                case ADDR_ZPX:
+                case ADDR_ZPY:
+                case ADDR_ABSO:
+                case ADDR_ABSX:
+                case ADDR_ABSY:
+                case ADDR_INDX:
+                case ADDR_INDY:
+                case ADDR_IZP:
+                    return 1;
+
+                default:
+                    return 0;
+            }
+    }
+}
+
+// build the dispatch tables of the selected cpu
+static void batch_init(void) {
+    for (int i = 0; i < 256; i++) {
+        const char* name = cpu_mnemonic(i);
+        size_t j = 0;
+
+        while (j < sizeof(instructions) / sizeof(instructions[0]) && strcmp(instructions[j].name, name) != 0) {
+            j++;
+        }
+
+        modes[i] = cpu_mode(i);
+        kinds[i] = KIND_SCALAR;
+        operations[i] = NULL;
+
+        if (j < sizeof(instructions) / sizeof(instructions[0]) && batch_vectorizable(instructions[j].kind, modes[i])) {
+            kinds[i] = instructions[j].kind;
+            operations[i] = instructions[j].operation;
+        }
+
+        if (operations[i] == bit && modes[i] == ADDR_IMM) {
+            operations[i] = bit_imm;
+        }
+    }
+}
+
+// every lane starts as a copy of the running machine, sharing its
+// memory pages until it writes to them.
+// return NULL if the lanes couldn't be allocated
+struct batch* batch_create(int lanes) {
+    struct batch* batch = calloc(1, sizeof(struct batch));
+    if (!batch || lanes <= 0) {
+        free(batch);
+        return NULL;
+    }
+
+    batch_init();
+
+    int padded = (lanes + BATCH_ALIGN - 1) / BATCH_ALIGN * BATCH_ALIGN;
+    batch->lanes = lanes;
+    batch->padded = padded;
+
+    batch->pc = aligned_alloc(BATCH_ALIGN, padded * sizeof(uint16_t));
+    batch->sp = aligned_alloc(BATCH_ALIGN, padded);
+    batch->status = aligned_alloc(BATCH_ALIGN, padded);
+    batch->a = aligned_alloc(BATCH_ALIGN, padded);
+    batch->x = aligned_alloc(BATCH_ALIGN, padded);
+    batch->y = aligned_alloc(BATCH_ALIGN, padded);
+    batch->cycles = aligned_alloc(BATCH_ALIGN, padded * sizeof(uint64_t));
+    batch->memory = calloc(padded, sizeof(struct memory*));
+    batch->running = aligned_alloc(BATCH_ALIGN, padded);
+    batch->mask = aligned_alloc(BATCH_ALIGN, padded);
+    batch->value = aligned_alloc(BATCH_ALIGN, padded);
+    batch->address = aligned_alloc(BATCH_ALIGN, padded * sizeof(uint16_t));
+    batch->members = malloc(padded * sizeof(int));
+
+    if (!batch->pc || !batch->sp || !batch->status || !batch->a || !batch->x || !batch->y || !batch->cycles ||
+        !batch->memory || !batch->running || !batch->mask || !batch->value || !batch->address || !batch->members) {
+        batch_free(batch);
+        return NULL;
+    }
+
+    struct cpu_state state;
+    cpu_save(&state);
+
+    for (int lane = 0; lane < padded; lane++) {
+        batch->pc[lane] = state.pc;
+        batch->sp[lane] = state.sp;
+        batch->status[lane] = state.status;
+        batch->a[lane] = state.a;
+        batch->x[lane] = state.x;
+        batch->y[lane] = state.y;
+        batch->cycles[lane] = 0;
+        batch->running[lane] = 0;
+        batch->mask[lane] = 0;
+        batch->value[lane] = 0;
+
+        if (lane < lanes && !(batch->memory[lane] = memory_fork(state.memory))) {
+            batch_free(batch);
+            return NULL;
+        }
+    }
+
+    return batch;
+}
+
+void batch_free(struct batch* batch) {
+    if (!batch) {
+        return;
+    }
+
+    for (int lane = 0; batch->memory && lane < batch->lanes; lane++) {
+        if (batch->memory[lane]) {
+            memory_free(batch->memory[lane]);
+        }
+    }
+
+    free(batch->pc);
+    free(batch->sp);
+    free(batch->status);
+    free(batch->a);
+    free(batch->x);
+    free(batch->y);
+    free(batch->cycles);
+    free(batch->memory);
+    free(batch->running);
+    free(batch->mask);
+    free(batch->value);
+    free(batch->address);
+    free(batch->members);
+    free(batch);
+}
+
+void batch_read(struct batch* batch, int lane, uint16_t address, uint8_t* buffer, uint32_t length) {
+    struct memory* active = memory_active;
+
+    memory_active = batch->memory[lane];
+    memory_read_block(address, buffer, length);
+    memory_active = active;
+}
+
+void batch_write(struct batch* batch, int lane, uint16_t address, const uint8_t* buffer, uint32_t length) {
+    struct memory* active = memory_active;
+
+    memory_active = batch->memory[lane];
+    memory_write_block(address, buffer, length);
+    memory_active = active;
+}
+
+// the slow paths work on the active address space, batch_run
+// puts the one of the running machine back when it is done
+static uint8_t batch_read8(struct memory* space, uint16_t address) {
+    uint8_t* page = space->read_pages[address >> 8];
+    if (page) {
+        return page[address & 0xff];
+    }
+
+    memory_active = space;
+    return memory_read_fault(address);
+}
+
+static void batch_write8(struct memory* space, uint16_t address, uint8_t value) {
+    uint8_t* page = space->write_pages[address >> 8];
+    if (page) {
+        page[address & 0xff] = value;
+        return;
+    }
+
+    memory_active = space;
+    memory_write_fault(address, value);
+    batch_faulted = 1;
+}
+
+static uint16_t batch_read16_zp(struct memory* space, uint8_t address) {
+    return batch_read8(space, address) | (uint16_t) batch_read8(space, (uint8_t) (address + 1)) << 8;
+}
+
+// the operand address of one lane, with crossed set when indexing crossed a page
+static uint16_t batch_address(struct batch* batch, int lane, uint8_t mode, uint16_t operand, int* crossed) {
+    uint16_t base;
+
+    switch (mode) {
+        case ADDR_ZP:
+            return operand;
+
+        case ADDR_ZPX:
+            return (uint8_t) (operand + batch->x[lane]);
+
+        case ADDR_ZPY:
+            return (uint8_t) (operand + batch->y[lane]);
+
+        case ADDR_ABSX:
+            *crossed = (operand & 0xff) + batch->x[lane] > 0xff;
+            return operand + batch->x[lane];
+
+        case ADDR_ABSY:
+            *crossed = (operand & 0xff) + batch->y[lane] > 0xff;
+            return operand + batch->y[lane];
+
+        case ADDR_INDX:
+            return batch_read16_zp(batch->memory[lane], operand + batch->x[lane]);
+
+        case ADDR_INDY:
+            base = batch_read16_zp(batch->memory[lane], operand);
+            *crossed = (base & 0xff) + batch->y[lane] > 0xff;
+            return base + batch->y[lane];
+
+        case ADDR_IZP:
+            return batch_read16_zp(batch->memory[lane], operand);
+
+        default:
+            return operand;
+    }
+}
+
+// run the operation on the lanes in the mask, a vector of lanes at a time.
+// accumulator instructions work on a instead of value
+static void batch_vectorized(struct batch* batch, void (*operation)(struct batch_chunk*), int accumulator) {
+    for (int i = 0; i < batch->padded; i += BATCH_WIDTH) {
+        batch_vector mask = VLOAD(batch->mask + i);
+        if (!VANY(mask)) {
+            continue;
+        }
+
+        struct batch_chunk before = {
+                VLOAD(batch->a + i), VLOAD(batch->x + i), VLOAD(batch->y + i),
+                VLOAD(batch->sp + i), VLOAD(batch->status + i), VLOAD(batch->value + i),
+        };
+
+        struct batch_chunk after = before;
+        if (accumulator) {
+            after.value = after.a;
+        }
+
+        operation(&after);
+
+        if (accumulator) {
+            after.a = after.value;
+        }
+
+        VSTORE(batch->a + i, VOR(VAND(mask, after.a), VANDNOT(mask, before.a)));
+        VSTORE(batch->x + i, VOR(VAND(mask, after.x), VANDNOT(mask, before.x)));
+        VSTORE(batch->y + i, VOR(VAND(mask, after.y), VANDNOT(mask, before.y)));
+        VSTORE(batch->sp + i, VOR(VAND(mask, after.sp), VANDNOT(mask, before.sp)));
+        VSTORE(batch->status + i, VOR(VAND(mask, after.status), VANDNOT(mask, before.status)));
+        VSTORE(batch->value + i, after.value);
+    }
+}
+
+// whether all of the lanes in the mask have value set (1), none (0) or some (-1)
+static int batch_agree(struct batch* batch) {
+    int set = 0;
+    int clear = 0;
+
+    for (int i = 0; i < batch->padded; i += BATCH_WIDTH) {
+        batch_vector mask = VLOAD(batch->mask + i);
+        batch_vector value = VLOAD(batch->value + i);
+
+        set |= VANY(VAND(mask, value)) != 0;
+        clear |= VANY(VANDNOT(value, mask)) != 0;
+    }
+
+    return set && clear ? -1 : set;
+}
+
+// run one lane on the fast core, for one instruction or until its pc
+// is at least end (-1 for one instruction) or its cycles ran out
+static void batch_scalar(struct batch* batch, int lane, uint64_t budget, int32_t end) {
+    struct cpu_state state = {
+            batch->pc[lane], batch->sp[lane], batch->status[lane], batch->a[lane],
+            batch->x[lane], batch->y[lane], 0, batch->memory[lane],
+    };
+
+    cpu_load(&state);
+
+    do {
+        batch->cycles[lane] += cpu_step();
+        batch->scalar_steps++;
+        cpu_save(&state);
+    } while (state.pc < end && batch->cycles[lane] < budget);
+
+    batch->running[lane] = batch->cycles[lane] < budget ? 0xff : 0;
+    batch->pc[lane] = state.pc;
+    batch->sp[lane] = state.sp;
+    batch->status[lane] = state.status;
+    batch->a[lane] = state.a;
+    batch->x[lane] = state.x;
+    batch->y[lane] = state.y;
+}
+
+// whether both address spaces hold the same instruction at address
+static int batch_same(struct memory* left, struct memory* right, uint16_t address) {
+    for (uint16_t i = 0; i < 3; i++) {
+        uint16_t at = address + i;
+        uint8_t* l = left->pages[at >> 8];
+        uint8_t* r = right->pages[at >> 8];
+
+        if (!l || !r || l[at & 0xff] != r[at & 0xff]) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// whether every lane has the page at the same storage. lanes only
+// move pages when memory_remaps goes up, until then the answer holds
+static int batch_uniform(struct batch* batch, uint8_t page) {
+    if (batch_compared[page] == memory_remaps + 1) {
+        return batch_uniform_pages[page];
+    }
+
+    uint8_t* first = batch->memory[0]->read_pages[page];
+    int lane = 1;
+
+    while (lane < batch->lanes && batch->memory[lane]->read_pages[page] == first) {
+        lane++;
+    }
+
+    batch_compared[page] = memory_remaps + 1;
+    batch_uniform_pages[page] = lane == batch->lanes;
+    return batch_uniform_pages[page];
+}
+
+// whether the lanes of the group run the same instruction at pc. they do
+// when they share the pages holding it, but once one of them wrote to
+// a page it has a copy of its own, and the bytes have to be compared
+static int batch_shared(struct batch* batch, struct batch_group* group, uint16_t pc) {
+    struct memory* code = batch->memory[batch->members[0]];
+    uint8_t* first = code->read_pages[pc >> 8];
+    uint8_t* last = code->read_pages[(uint16_t) (pc + 2) >> 8];
+
+    group->shared = first && last;
+    if (!group->shared) {
+        return 0;
+    }
+
+    if (batch_uniform(batch, pc >> 8) && batch_uniform(batch, (uint16_t) (pc + 2) >> 8)) {
+        return 1;
+    }
+
+    for (int i = 1; i < group->count; i++) {
+        struct memory* space = batch->memory[batch->members[i]];
+
+        if (space->read_pages[pc >> 8] != first || space->read_pages[(uint16_t) (pc + 2) >> 8] != last) {
+            group->shared = 0;
+
+            if (!batch_same(code, space, pc)) {
+                return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+// the lowest pc at or above from of the running lanes, $FFFF if there is
+// none. running is set to the number of running lanes unless NULL
+static uint16_t batch_lowest(struct batch* batch, uint16_t from, int* running) {
+    uint16_t lowest = 0xffff;
+    int count = 0;
+    int lane = 0;
+
+#ifdef __SSE2__
+    // there are no unsigned 16 bit compares before SSE4.1, the pcs
+    // are biased into signed ones instead
+    __m128i bias = _mm_set1_epi16((short) 0x8000);
+    __m128i floor = _mm_set1_epi16((short) (from ^ 0x8000));
+    __m128i low = _mm_set1_epi16(0x7fff);
+
+    for (; lane < batch->padded; lane += 8) {
+        __m128i live = _mm_loadl_epi64((const __m128i*) (batch->running + lane));
+        __m128i pc = _mm_xor_si128(_mm_load_si128((const __m128i*) (batch->pc + lane)), bias);
+        __m128i below = _mm_cmpgt_epi16(floor, pc);
+
+        live = _mm_unpacklo_epi8(live, live);
+        count += __builtin_popcount(_mm_movemask_epi8(live)) / 2;
+        low = _mm_min_epi16(low, _mm_or_si128(_mm_and_si128(live, _mm_andnot_si128(below, pc)),
+                                              _mm_andnot_si128(_mm_andnot_si128(below, live), _mm_set1_epi16(0x7fff))));
+    }
+
+    int16_t lows[8];
+    _mm_storeu_si128((__m128i*) lows, low);
+
+    for (int i = 0; i < 8; i++) {
+        lowest = (uint16_t) (lows[i] ^ 0x8000) < lowest ? (uint16_t) (lows[i] ^ 0x8000) : lowest;
+    }
+#endif
+
+    for (; lane < batch->padded; lane++) {
+        if (batch->running[lane]) {
+            count++;
+            lowest = batch->pc[lane] >= from && batch->pc[lane] < lowest ? batch->pc[lane] : lowest;
+        }
+    }
+
+    if (running) {
+        *running = count;
+    }
+
+    return lowest;
+}
+
+// put the running lanes at pc in the mask and the members.
+// return how many there are
+static int batch_select(struct batch* batch, uint16_t pc) {
+    int count = 0;
+    int lane = 0;
+
+#ifdef __SSE2__
+    __m128i at = _mm_set1_epi16((short) pc);
+
+    for (; lane < batch->padded; lane += 16) {
+        __m128i first = _mm_cmpeq_epi16(_mm_load_si128((const __m128i*) (batch->pc + lane)), at);
+        __m128i second = _mm_cmpeq_epi16(_mm_load_si128((const __m128i*) (batch->pc + lane + 8)), at);
+        __m128i mask = _mm_and_si128(_mm_packs_epi16(first, second), _mm_load_si128((const __m128i*) (batch->running + lane)));
+
+        _mm_store_si128((__m128i*) (batch->mask + lane), mask);
+
+        for (uint32_t bits = _mm_movemask_epi8(mask); bits; bits &= bits - 1) {
+            batch->members[count++] = lane + __builtin_ctz(bits);
+        }
+    }
+#endif
+
+    for (; lane < batch->padded; lane++) {
+        batch->mask[lane] = batch->running[lane] && batch->pc[lane] == pc ? 0xff : 0;
+        if (batch->mask[lane]) {
+            batch->members[count++] = lane;
+        }
+    }
+
+    return count;
+}
+
+// gather the running lanes at the lowest pc into the group. the lanes
+// further ahead wait there for the others to catch up, which is where
+// the paths of an if or a loop join back. lanes running other code at
+// that pc, and groups too small to be worth it, go on the fast core.
+// return the number of lanes in the group, 0 when every lane is done
+static int batch_gather(struct batch* batch, struct batch_group* group, uint64_t budget) {
+    for (;;) {
+        int running;
+        uint16_t low = batch_lowest(batch, 0, &running);
+
+        if (!running) {
+            return 0;
+        }
+
+        uint16_t above = low == 0xffff ? 0xffff : batch_lowest(batch, low + 1, NULL);
+        int selected = batch_select(batch, low);
+
+        struct memory* code = batch->memory[batch->members[0]];
+        uint8_t* first = code->read_pages[low >> 8];
+        uint8_t* last = code->read_pages[(uint16_t) (low + 2) >> 8];
+        int uniform = batch_uniform(batch, low >> 8) && batch_uniform(batch, (uint16_t) (low + 2) >> 8);
+        int count = 0;
+        int shared = 1;
+        uint64_t slack = UINT64_MAX;
+
+        for (int i = 0; i < selected; i++) {
+            int lane = batch->members[i];
+            struct memory* space = batch->memory[lane];
+            int same = uniform ||
+                       (space->read_pages[low >> 8] == first && space->read_pages[(uint16_t) (low + 2) >> 8] == last);
+
+            if (first && last && (same || batch_same(code, space, low))) {
+                batch->members[count++] = lane;
+                shared &= same;
+                slack = budget - batch->cycles[lane] < slack ? budget - batch->cycles[lane] : slack;
+            } else {
+                batch->mask[lane] = 0;
+                batch_scalar(batch, lane, budget, -1);
+            }
+        }
+
+        if (count * BATCH_PEEL >= running) {
+            group->count = count;
+            group->pc = low;
+            group->next = above;
+            group->elapsed = 0;
+            group->slack = slack;
+            group->shared = shared;
+            return count;
+        }
+
+        for (int i = 0; i < count; i++) {
+            batch_scalar(batch, batch->members[i], budget, above);
+        }
+    }
+}
+
+// hand the cycles the group ran to its members, and the pc they are all
+// at unless they went separate ways (-1)
+static void batch_flush(struct batch* batch, struct batch_group* group, int32_t pc, uint64_t budget) {
+    for (int i = 0; i < group->count; i++) {
+        int lane = batch->members[i];
+
+        batch->cycles[lane] += group->elapsed;
+        batch->running[lane] = batch->cycles[lane] < budget ? 0xff : 0;
+        if (pc >= 0) {
+            batch->pc[lane] = pc;
+        }
+    }
+
+    group->elapsed = 0;
+}
+
+// the cycles only some lanes of the group spend, on crossing a page or
+// taking a branch the others don't
+static void batch_extra(struct batch* batch, struct batch_group* group, int lane, uint8_t extra, uint64_t budget) {
+    batch->cycles[lane] += extra;
+
+    uint64_t left = budget > batch->cycles[lane] ? budget - batch->cycles[lane] : 0;
+    if (left < group->slack) {
+        group->slack = left;
+    }
+}
+
+// run the instruction at the pc of the group on all of its lanes.
+// return the pc they are all at afterwards, -1 if they went separate ways
+static int32_t batch_step(struct batch* batch, struct batch_group* group, uint64_t budget) {
+    struct memory* code = batch->memory[batch->members[0]];
+    uint16_t pc = group->pc;
+    int count = group->count;
+
+    uint8_t opcode = batch_read8(code, pc);
+    uint8_t mode = modes[opcode];
+    uint8_t kind = kinds[opcode];
+    void (*operation)(struct batch_chunk*) = operations[opcode];
+
+    // the fast core fetches the operand itself
+    if (kind == KIND_SCALAR) {
+        batch_flush(batch, group, pc, budget);
+
+        for (int i = 0; i < count; i++) {
+            batch_scalar(batch, batch->members[i], budget, -1);
+        }
+
+        return -1;
+    }
+
+    uint16_t length = mode == ADDR_IMP ? 1 : mode == ADDR_ABSO || mode == ADDR_ABSX || mode == ADDR_ABSY ? 3 : 2;
+    uint16_t operand = length > 1 ? batch_read8(code, pc + 1) : 0;
+    if (length > 2) {
+        operand |= (uint16_t) batch_read8(code, pc + 2) << 8;
+    }
+
+    uint16_t target = pc + length;
+    uint8_t cycles = cpu_cycles(opcode, 0);
+    uint8_t penalty = cpu_cycles(opcode, 1) - cycles;
+    int32_t after = target;
+
+    batch->vector_steps += count;
+    group->elapsed += cycles;
+
+    switch (kind) {
+        case KIND_IMPLIED:
+            batch_vectorized(batch, operation, 0);
+            break;
+
+        case KIND_READ:
+            if (mode == ADDR_IMP || mode == ADDR_IMM) {
+                memset(batch->value, operand, batch->padded);
+                batch_vectorized(batch, operation, mode == ADDR_IMP);
+                break;
+            }
+
+            for (int i = 0; i < count; i++) {
+                int lane = batch->members[i];
+                int crossed = 0;
+                uint16_t address = batch_address(batch, lane, mode, operand, &crossed);
+
+                batch->value[lane] = batch_read8(batch->memory[lane], address);
+                if (penalty && crossed) {
+                    batch_extra(batch, group, lane, penalty, budget);
+                }
+            }
+
+            batch_vectorized(batch, operation, 0);
+            break;
+
+        case KIND_WRITE:
+            batch_vectorized(batch, operation, 0);
+
+            for (int i = 0; i < count; i++) {
+                int lane = batch->members[i];
+                int crossed = 0;
+                uint16_t address = batch_address(batch, lane, mode, operand, &crossed);
+
+                batch_write8(batch->memory[lane], address, batch->value[lane]);
+                if (penalty && crossed) {
+                    batch_extra(batch, group, lane, penalty, budget);
+                }
+            }
+            break;
+
+        case KIND_MODIFY:
+            if (mode == ADDR_IMP) {
+                batch_vectorized(batch, operation, 1);
+                break;
+            }
+
+            for (int i = 0; i < count; i++) {
+                int lane = batch->members[i];
+                int crossed = 0;
+
+                batch->address[lane] = batch_address(batch, lane, mode, operand, &crossed);
+                batch->value[lane] = batch_read8(batch->memory[lane], batch->address[lane]);
+                if (penalty && crossed) {
+                    batch_extra(batch, group, lane, penalty, budget);
+                }
+            }
+
+            batch_vectorized(batch, operation, 0);
+
+            for (int i = 0; i < count; i++) {
+                int lane = batch->members[i];
+                batch_write8(batch->memory[lane], batch->address[lane], batch->value[lane]);
+            }
+            break;
+
+        case KIND_BRANCH: {
+            // a taken branch costs a cycle, and one more to a different page
+            uint16_t destination = target + (int8_t) operand;
+            uint8_t taken = 1 + ((destination ^ target) > 0xff);
+
+            batch_vectorized(batch, operation, 0);
+
+            switch (batch_agree(batch)) {
+                case 1:
+                    group->elapsed += taken;
+                    after = destination;
+                    break;
+
+                case -1:
+                    for (int i = 0; i < count; i++) {
+                        int lane = batch->members[i];
+
+                        batch->pc[lane] = target;
+                        if (batch->value[lane]) {
+                            batch->pc[lane] = destination;
+                            batch_extra(batch, group, lane, taken, budget);
+                        }
+                    }
+
+                    after = -1;
+                    break;
+            }
+            break;
+        }
+
+        case KIND_JUMP:
+            after = operand;
+            break;
+
+        case KIND_CALL:
+            for (int i = 0; i < count; i++) {
+                int lane = batch->members[i];
+                uint16_t pushed = pc + 2;
+
+                batch_write8(batch->memory[lane], 0x0100 + batch->sp[lane]--, pushed >> 8);
+                batch_write8(batch->memory[lane], 0x0100 + batch->sp[lane]--, pushed & 0xff);
+            }
+
+            after = operand;
+            break;
+
+        case KIND_RETURN:
+            for (int i = 0; i < count; i++) {
+                int lane = batch->members[i];
+                uint16_t pulled = batch_read8(batch->memory[lane], 0x0100 + ++batch->sp[lane]);
+                pulled |= (uint16_t) batch_read8(batch->memory[lane], 0x0100 + ++batch->sp[lane]) << 8;
+
+                batch->pc[lane] = pulled + 1;
+                after = i == 0 || batch->pc[lane] == after ? batch->pc[lane] : -2;
+            }
+
+            after = after < 0 ? -1 : after;
+            break;
+
+        case KIND_PUSH:
+            for (int i = 0; i < count; i++) {
+                int lane = batch->members[i];
+                batch_write8(batch->memory[lane], 0x0100 + batch->sp[lane]--, batch->a[lane]);
+            }
+            break;
+
+        case KIND_PULL:
+            for (int i = 0; i < count; i++) {
+                int lane = batch->members[i];
+                batch->value[lane] = batch_read8(batch->memory[lane], 0x0100 + ++batch->sp[lane]);
+            }
+
+            batch_vectorized(batch, operation, 0);
+            break;
+    }
+
+    return after;
+}
+
+// run every lane until it used up its cycles, like cpu_run each one
+// goes by whole instructions and can overshoot by a few cycles. the
+// lanes run without interrupts, and are meant for programs working on
+// memory alone: devices see the accesses of every lane
+void batch_run(struct batch* batch, uint64_t cycles) {
+    struct cpu_state state;
+    uint8_t irq_lines = cpu_irq_lines;
+    uint8_t nmi_pending = cpu_nmi_pending;
+
+    cpu_save(&state);
+    cpu_irq_lines = 0;
+    cpu_nmi_pending = 0;
+
+    for (int lane = 0; lane < batch->lanes; lane++) {
+        batch->running[lane] = batch->cycles[lane] < cycles ? 0xff : 0;
+    }
+
+    struct batch_group group = {0};
+    memset(batch_compared, 0, sizeof(batch_compared));
+
+    for (;;) {
+        if (!group.count && !batch_gather(batch, &group, cycles)) {
+            break;
+        }
+
+        batch_faulted = 0;
+        int32_t after = batch_step(batch, &group, cycles);
+
+        // the group stays together as long as it is the furthest behind,
+        // has cycles left and runs the same code. that only needs checking
+        // again once a lane copied a page or the group moved to other pages
+        int together = after >= 0 && (uint32_t) after < group.next && group.elapsed < group.slack;
+        int moved = (after ^ group.pc) > 0xff || ((uint16_t) (after + 2) ^ (uint16_t) (group.pc + 2)) > 0xff;
+
+        if (together && (!group.shared || batch_faulted || moved)) {
+            together = batch_shared(batch, &group, after);
+        }
+
+        if (together) {
+            group.pc = after;
+            continue;
+        }
+
+        batch_flush(batch, &group, after, cycles);
+        group.count = 0;
+    }
+
+    cpu_load(&state);
+    cpu_irq_lines = irq_lines;
+    cpu_nmi_pending = nmi_pending;
+}
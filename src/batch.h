@@ -0,0 +1,47 @@
+#ifndef CURSES6502_BATCH_H
+#define CURSES6502_BATCH_H
+
+#include <stdint.h>
+
+struct memory;
+
+// many copies of one machine run side by side, for sweeping a program
+// over different inputs. the registers are kept one array per register
+// so that the lanes sharing a pc can be stepped with vector instructions
+struct batch {
+    int lanes;
+    int padded; // lanes rounded up to whole vectors, the extra lanes never run
+
+    uint16_t* pc;
+    uint8_t* sp;
+    uint8_t* status;
+    uint8_t* a;
+    uint8_t* x;
+    uint8_t* y;
+    uint64_t* cycles;
+    struct memory** memory;
+
+    // 0xFF for the lanes still running, and for the lanes in the step being run
+    uint8_t* running;
+    uint8_t* mask;
+
+    // the operand and its address, per lane
+    uint8_t* value;
+    uint16_t* address;
+
+    int* members;
+
+    // the instructions run by lanes stepped together, and by lanes stepped alone
+    uint64_t vector_steps;
+    uint64_t scalar_steps;
+};
+
+struct batch* batch_create(int lanes);
+void batch_free(struct batch* batch);
+
+void batch_read(struct batch* batch, int lane, uint16_t address, uint8_t* buffer, uint32_t length);
+void batch_write(struct batch* batch, int lane, uint16_t address, const uint8_t* buffer, uint32_t length);
+
+void batch_run(struct batch* batch, uint64_t cycles);
+
+#endif
@@ -0,0 +1,169 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "console.h"
+#include "cpu.h"
+#include "memory.h"
+
+#define CONSOLE_BUFFER_SIZE 0x10000
+
+uint16_t console_base;
+uint8_t console_control = 0;
+
+int console_output = -1;
+int console_input = -1;
+
+// bytes the cpu sent, written out in large chunks
+uint8_t console_tx[CONSOLE_BUFFER_SIZE];
+uint32_t console_tx_length = 0;
+
+// bytes read ahead from the input for the cpu to receive
+uint8_t console_rx[CONSOLE_BUFFER_SIZE];
+uint32_t console_rx_start = 0;
+uint32_t console_rx_length = 0;
+
+// stdout can be non-blocking when it shares its file with a terminal
+// someone else set up, the output then waits until it is writable
+void console_flush(void) {
+    uint32_t written = 0;
+
+    while (written < console_tx_length) {
+        ssize_t result = write(console_output, console_tx + written, console_tx_length - written);
+        if (result == -1 && errno == EINTR) {
+            continue;
+        }
+
+        if (result == -1 && errno == EAGAIN) {
+            struct pollfd writable = {console_output, POLLOUT, 0};
+            poll(&writable, 1, -1);
+            continue;
+        }
+
+        if (result <= 0) {
+            break;
+        }
+
+        written += result;
+    }
+
+    console_tx_length = 0;
+}
+
+void console_update_irq(void) {
+    cpu_irq(IRQ_CONSOLE, (console_control & CONSOLE_CONTROL_RX_IRQ) && console_rx_length);
+}
+
+uint8_t console_read(uint16_t address) {
+    switch (address - console_base) {
+        case CONSOLE_DATA:
+            if (!console_rx_length) {
+                return 0;
+            }
+
+            uint8_t value = console_rx[console_rx_start++];
+            console_rx_length--;
+            console_update_irq();
+            return value;
+
+        case CONSOLE_STATUS:
+            return CONSOLE_STATUS_TX_READY | (console_rx_length ? CONSOLE_STATUS_RX_READY : 0);
+
+        default:
+            return console_control;
+    }
+}
+
+void console_write(uint16_t address, uint8_t value) {
+    switch (address - console_base) {
+        case CONSOLE_DATA:
+            console_tx[console_tx_length++] = value;
+            if (console_tx_length == CONSOLE_BUFFER_SIZE) {
+                console_flush();
+            }
+
+            break;
+
+        case CONSOLE_CONTROL:
+            console_control = value;
+            console_update_irq();
+            break;
+    }
+}
+
+// output and input are file names, "-" for stdout and stdin
+// and NULL to leave that direction unconnected.
+// return 1 if should abort, 0 otherwise
+int console_init(uint16_t base, const char* output, const char* input) {
+    if (output) {
+        console_output = output[0] == '-' && !output[1] ? STDOUT_FILENO : open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (console_output == -1) {
+            fprintf(stderr, "Could not open %s.\n", output);
+            return 1;
+        }
+    }
+
+    if (input) {
+        console_input = input[0] == '-' && !input[1] ? STDIN_FILENO : open(input, O_RDONLY);
+        if (console_input == -1) {
+            fprintf(stderr, "Could not open %s.\n", input);
+            return 1;
+        }
+    }
+
+    console_base = base;
+
+    struct memory_device device = {
+            .start = base,
+            .end = base + CONSOLE_CONTROL,
+            .read = console_read,
+            .write = console_write,
+    };
+    memory_add_device(&device);
+
+    return 0;
+}
+
+// called between time slices, never per character: writes out what the
+// cpu sent and refills the receive buffer once the cpu drained it
+void console_poll(void) {
+    if (console_output != -1 && console_tx_length) {
+        console_flush();
+    }
+
+    // the cpu never waits for input. the file isn't made non-blocking:
+    // stdin usually shares it with stdout and the shell after exit
+    struct pollfd readable = {console_input, POLLIN, 0};
+
+    if (console_input != -1 && !console_rx_length && poll(&readable, 1, 0) == 1) {
+        ssize_t result = read(console_input, console_rx, CONSOLE_BUFFER_SIZE);
+
+        if (result > 0) {
+            console_rx_start = 0;
+            console_rx_length = result;
+            console_update_irq();
+        } else if (result == 0) {
+            // end of the input
+            if (console_input != STDIN_FILENO) {
+                close(console_input);
+            }
+
+            console_input = -1;
+        }
+    }
+}
+
+void console_free(void) {
+    if (console_output != -1) {
+        console_flush();
+
+        if (console_output != STDOUT_FILENO) {
+            close(console_output);
+        }
+    }
+
+    if (console_input != -1 && console_input != STDIN_FILENO) {
+        close(console_input);
+    }
+}
@@ -0,0 +1,20 @@
+#ifndef CURSES6502_CONSOLE_H
+#define CURSES6502_CONSOLE_H
+
+#include <stdint.h>
+
+// registers, relative to the base address of the console
+#define CONSOLE_DATA 0     // write to send a byte, read to receive one
+#define CONSOLE_STATUS 1   // read only
+#define CONSOLE_CONTROL 2
+
+#define CONSOLE_STATUS_RX_READY (1 << 0)
+#define CONSOLE_STATUS_TX_READY (1 << 1)
+
+#define CONSOLE_CONTROL_RX_IRQ (1 << 0)
+
+int console_init(uint16_t base, const char* output, const char* input);
+void console_poll(void);
+void console_free(void);
+
+#endif
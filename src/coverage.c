@@ -0,0 +1,152 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <unistd.h>
+#include "coverage.h"
+
+#ifdef CURSES6502_COVERAGE
+
+#define COVERAGE_MAX_FILES 256
+
+struct coverage coverage;
+
+void coverage_merge(struct coverage* into, const struct coverage* from) {
+    for (int i = 0; i < COVERAGE_WORDS; i++) {
+        into->executed[i] |= from->executed[i];
+        into->taken[i] |= from->taken[i];
+        into->not_taken[i] |= from->not_taken[i];
+    }
+}
+
+// OR this run into the raw coverage file. the file is locked while
+// merging so that any number of runs can share the same file.
+// return 1 if the merge failed, 0 otherwise
+int coverage_merge_file(const char* path) {
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd == -1 || flock(fd, LOCK_EX) == -1) {
+        fprintf(stderr, "Could not open %s.\n", path);
+        return 1;
+    }
+
+    struct coverage previous;
+    if (read(fd, &previous, sizeof(previous)) == sizeof(previous)) {
+        coverage_merge(&coverage, &previous);
+    }
+
+    int failed = pwrite(fd, &coverage, sizeof(coverage), 0) != sizeof(coverage);
+    if (failed) {
+        fprintf(stderr, "Could not write %s.\n", path);
+    }
+
+    close(fd);
+    return failed;
+}
+
+// the listing maps addresses to source lines, one "<address> <file>:<line>"
+// per line with the address in hex. addresses outside of the listing are
+// reported against image, the name of the binary, with address N on line N + 1
+int coverage_export_lcov(const char* path, const char* listing, const char* image) {
+    static uint16_t address_file[0x10000];
+    static uint32_t address_line[0x10000];
+    const char* files[COVERAGE_MAX_FILES];
+    int file_count = 1;
+
+    files[0] = image;
+    for (int i = 0; i < 0x10000; i++) {
+        address_file[i] = 0;
+        address_line[i] = i + 1;
+    }
+
+    FILE* file;
+    if (listing) {
+        file = fopen(listing, "r");
+        if (!file) {
+            fprintf(stderr, "Could not open %s.\n", listing);
+            return 1;
+        }
+
+        char line[512];
+        while (fgets(line, sizeof(line), file)) {
+            unsigned int address;
+            unsigned int source_line;
+            char source[400];
+
+            if (sscanf(line, "%x %399[^:]:%u", &address, source, &source_line) != 3 || address > 0xffff) {
+                continue;
+            }
+
+            int index = 0;
+            while (index < file_count && strcmp(files[index], source) != 0) {
+                index++;
+            }
+
+            if (index == file_count) {
+                if (file_count == COVERAGE_MAX_FILES) {
+                    continue;
+                }
+
+                files[file_count++] = strdup(source);
+            }
+
+            address_file[address] = index;
+            address_line[address] = source_line;
+        }
+
+        fclose(file);
+    }
+
+    file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "Could not open %s.\n", path);
+        return 1;
+    }
+
+    fprintf(file, "TN:\n");
+
+    for (int f = 0; f < file_count; f++) {
+        int lines_found = 0;
+        int lines_hit = 0;
+        int branches_found = 0;
+        int branches_hit = 0;
+
+        fprintf(file, "SF:%s\n", files[f]);
+
+        for (int i = 0; i < 0x10000; i++) {
+            // addresses from the listing are instructions whether they ran or not,
+            // the others are only known once they ran
+            int executed = COVERAGE_GET(coverage.executed, i);
+            if (address_file[i] != f || (f == 0 && !executed)) {
+                continue;
+            }
+
+            lines_found++;
+            lines_hit += executed;
+            fprintf(file, "DA:%u,%d\n", address_line[i], executed);
+
+            int taken = COVERAGE_GET(coverage.taken, i);
+            int not_taken = COVERAGE_GET(coverage.not_taken, i);
+            if (taken || not_taken) {
+                branches_found += 2;
+                branches_hit += taken + not_taken;
+                fprintf(file, "BRDA:%u,%d,0,%d\n", address_line[i], i, taken);
+                fprintf(file, "BRDA:%u,%d,1,%d\n", address_line[i], i, not_taken);
+            }
+        }
+
+        fprintf(file, "BRF:%d\nBRH:%d\n", branches_found, branches_hit);
+        fprintf(file, "LF:%d\nLH:%d\n", lines_found, lines_hit);
+        fprintf(file, "end_of_record\n");
+    }
+
+    fclose(file);
+
+    for (int f = 1; f < file_count; f++) {
+        free((char*) files[f]);
+    }
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef CURSES6502_COVERAGE_H
+#define CURSES6502_COVERAGE_H
+
+#include <stdint.h>
+
+#ifdef CURSES6502_COVERAGE
+
+#define COVERAGE_WORDS (0x10000 / 64)
+
+// one bit per address. taken and not_taken are indexed by
+// the address of the branch instruction
+struct coverage {
+    uint64_t executed[COVERAGE_WORDS];
+    uint64_t taken[COVERAGE_WORDS];
+    uint64_t not_taken[COVERAGE_WORDS];
+};
+
+extern struct coverage coverage;
+
+#define COVERAGE_SET(bitmap, address) bitmap[(uint16_t) (address) >> 6] |= (uint64_t) 1 << ((address) & 63);
+#define COVERAGE_GET(bitmap, address) ((bitmap[(uint16_t) (address) >> 6] >> ((address) & 63)) & 1)
+
+#define COVERAGE_EXECUTE(address) COVERAGE_SET(coverage.executed, address)
+#define COVERAGE_BRANCH(address, is_taken) COVERAGE_SET((is_taken ? coverage.taken : coverage.not_taken), address)
+
+void coverage_merge(struct coverage* into, const struct coverage* from);
+
+int coverage_merge_file(const char* path);
+int coverage_export_lcov(const char* path, const char* listing, const char* image);
+
+#else
+
+#define COVERAGE_EXECUTE(address)
+#define COVERAGE_BRANCH(address, is_taken)
+
+#endif
+
+#endif
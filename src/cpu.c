@@ -1,73 +1,180 @@
+#include <stdio.h>
+#include <string.h>
+#include "coverage.h"
 #include "cpu.h"
-
-// 6502 registers
-uint16_t pc;
-uint8_t sp;
-uint8_t status;
-uint8_t a;
-uint8_t x;
-uint8_t y;
+#include "heatmap.h"
+#include "memory.h"
+
+// 6502 registers, only reachable through cpu_save and cpu_load
+// so that the core doesn't export bare names to its host
+static uint16_t pc;
+static uint8_t sp;
+static uint8_t status;
+static uint8_t a;
+static uint8_t x;
+static uint8_t y;
 
 uint8_t cpu_memory[0x10000] = {0 };
 
-uint8_t cycles = 0;
-uint8_t fetched = 0;
-uint16_t relative_address = 0;
-uint16_t absolute_address = 0;
+static uint8_t cycles = 0;
+static uint8_t fetched = 0;
+static uint16_t relative_address = 0;
+static uint16_t absolute_address = 0;
+
+static uint8_t addr_mode = 0;
+
+static uint8_t instruction = 0;
+
+// one bit per device holding the IRQ line low, shared with the
+// cycle-exact core like the pending NMI
+uint8_t cpu_irq_lines = 0;
+uint8_t cpu_nmi_pending = 0;
+
+uint8_t cpu_events = 0;
+
+uint64_t cpu_instructions = 0;
+uint64_t cpu_irq_count = 0;
+uint64_t cpu_nmi_count = 0;
+uint64_t cpu_brk_count = 0;
 
-uint8_t addr_mode = 0;
+// the dispatch tables of one cpu model, the running one is picked
+// once with cpu_select so that no handler has to check for it
+struct cpu_variant {
+    const char* name;
+    void (*addr_modes[256])(void);
+    void (*opcodes[256])(void);
+    uint8_t cycles[256];
+    uint8_t interrupt_status; // the status bits taking an interrupt keeps
+};
+
+static const struct cpu_variant nmos;
+static const struct cpu_variant cmos;
+static const struct cpu_variant* variant = &nmos;
 
-uint8_t instruction = 0;
+static uint8_t read8(uint16_t address) {
+    HEATMAP_READ(address)
 
-void (*addr_modes[256])(void);
-void (*opcodes[256])(void);
-uint8_t instruction_cycles[256];
+    uint8_t* page = memory_active->read_pages[address >> 8];
+    if (page) {
+        return page[address & 0xff];
+    }
 
-uint8_t read8(uint16_t address) {
-    return cpu_memory[address];
+    return memory_read_fault(address);
 }
 
-uint16_t read16(uint16_t address) {
+// the opcode fetch, which the heatmap counts as an execute only
+static uint8_t fetch8(uint16_t address) {
+    uint8_t* page = memory_active->read_pages[address >> 8];
+    if (page) {
+        return page[address & 0xff];
+    }
+
+    return memory_read_fault(address);
+}
+
+static uint16_t read16(uint16_t address) {
     uint8_t lo = read8(address);
     uint8_t hi = read8(address + 1);
 
     return (uint16_t) hi << 8 | lo;
 }
 
-void write8(uint16_t address, uint8_t value) {
-    cpu_memory[address] = value;
+// a pointer in the zero page wraps around within it
+static uint16_t read16_zp(uint8_t address) {
+    uint8_t lo = read8(address);
+    uint8_t hi = read8((uint8_t) (address + 1));
+
+    return (uint16_t) hi << 8 | lo;
 }
 
-void push16(uint16_t value) {
-    cpu_memory[0x0100 + sp--] = value >> 8 & 0xff;
-    cpu_memory[0x0100 + sp--] = value & 0xff;
+static void write8(uint16_t address, uint8_t value) {
+    HEATMAP_WRITE(address)
+
+    uint8_t* page = memory_active->write_pages[address >> 8];
+    if (page) {
+        page[address & 0xff] = value;
+        return;
+    }
+
+    memory_write_fault(address, value);
+}
+
+static void push8(uint8_t value);
+static uint8_t pull8(void);
+
+static void push16(uint16_t value) {
+    push8(value >> 8 & 0xff);
+    push8(value & 0xff);
 }
 
-void push8(uint8_t value) {
-    cpu_memory[0x0100 + sp--] = value;
+static void push8(uint8_t value) {
+    write8(0x0100 + sp--, value);
 }
 
-uint16_t pull16(void) {
-    uint16_t pulled = cpu_memory[0x0100 + ++sp];
-    pulled |= (uint16_t) cpu_memory[0x0100 + ++sp] << 8;
+static uint16_t pull16(void) {
+    uint16_t pulled = pull8();
+    pulled |= (uint16_t) pull8() << 8;
 
     return pulled;
 }
 
-uint8_t pull8(void) {
-    return cpu_memory[0x0100 + ++sp];
+static uint8_t pull8(void) {
+    return read8(0x0100 + ++sp);
 }
 
+// return the number of cycles the interrupt sequence takes
+static uint8_t cpu_interrupt(uint16_t vector, uint8_t event) {
+    push16(pc);
+    push8((status & ~FLAG_BREAK) | FLAG_UNUSED);
+    SETFLAG(FLAG_INTERRUPT, 1)
+    status &= variant->interrupt_status;
+
+    pc = read16(vector);
+    cpu_events |= event;
+
+    if (event == CPU_EVENT_NMI) {
+        cpu_nmi_count++;
+    } else {
+        cpu_irq_count++;
+    }
+
+    return 7;
+}
+
+// run the next instruction, or take a pending interrupt, all at once.
+// return the number of cycles it takes
+static inline uint8_t cpu_execute(void) {
+    // page crossings and taken branches add their cycles on top of the table
+    cycles = 0;
+
+    if (cpu_irq_lines | cpu_nmi_pending) {
+        if (cpu_nmi_pending) {
+            cpu_nmi_pending = 0;
+            return cpu_interrupt(0xFFFA, CPU_EVENT_NMI);
+        }
+
+        if (FLAGCLEAR(FLAG_INTERRUPT)) {
+            return cpu_interrupt(0xFFFE, CPU_EVENT_IRQ);
+        }
+    }
+
+    HEATMAP_EXECUTE(pc)
+    COVERAGE_EXECUTE(pc)
+    cpu_instructions++;
+    instruction = fetch8(pc++);
+    (*variant->addr_modes[instruction])();
+    (*variant->opcodes[instruction])();
+    return variant->cycles[instruction] + cycles;
+}
+
+// the instruction runs on its first cycle and the core idles through the rest
 void cpu_tick(void) {
     if (cycles != 0) {
         cycles--;
         return;
     }
 
-    instruction = read8(pc++);
-    (*addr_modes[instruction])();
-    (*opcodes[instruction])();
-    cycles = instruction_cycles[instruction];
+    cycles = cpu_execute() - 1;
 }
 
 void cpu_next_instruction(void) {
@@ -75,6 +182,90 @@ void cpu_next_instruction(void) {
     cycles = 0;
 }
 
+// drop what is left of the current instruction and run the next one.
+// return the number of cycles it takes
+uint8_t cpu_step(void) {
+    uint8_t taken = cpu_execute();
+    cycles = 0;
+
+    return taken;
+}
+
+// run whole instructions until at least *count cycles went by, one of
+// events happened or the pc reached address (-1 for none), then store
+// the number of cycles that actually ran in *count.
+// return the reason the cpu stopped, one of CPU_STOP_*
+int cpu_run(uint64_t* count, uint8_t events, int32_t address) {
+    uint64_t budget = *count;
+    uint64_t elapsed = 0;
+    int reason = CPU_STOP_CYCLES;
+
+    cpu_events = 0;
+    while (elapsed < budget) {
+        elapsed += cpu_execute();
+
+        if (cpu_events & events) {
+            reason = CPU_STOP_EVENT;
+            break;
+        }
+
+        if (pc == address) {
+            reason = CPU_STOP_PC;
+            break;
+        }
+    }
+
+    // the run always ends between two instructions
+    cycles = 0;
+    *count = elapsed;
+    return reason;
+}
+
+void cpu_save(struct cpu_state* state) {
+    state->pc = pc;
+    state->sp = sp;
+    state->status = status;
+    state->a = a;
+    state->x = x;
+    state->y = y;
+    state->cycles = cycles;
+    state->memory = memory_active;
+}
+
+void cpu_load(const struct cpu_state* state) {
+    pc = state->pc;
+    sp = state->sp;
+    status = state->status;
+    a = state->a;
+    x = state->x;
+    y = state->y;
+    cycles = state->cycles;
+    memory_active = state->memory;
+}
+
+// snapshot the running machine into child, sharing its memory
+// pages until either side writes to them.
+// return 1 if the fork failed, 0 otherwise
+int cpu_fork(struct cpu_state* child) {
+    cpu_save(child);
+
+    child->memory = memory_fork(memory_active);
+    return child->memory == NULL;
+}
+
+void cpu_irq(uint8_t source, int asserted) {
+    if (asserted) {
+        cpu_irq_lines |= source;
+    } else {
+        cpu_irq_lines &= ~source;
+    }
+}
+
+// the NMI is edge triggered, it is taken once per call
+void cpu_nmi(void) {
+    cpu_nmi_pending = 1;
+}
+
 void cpu_reset(void) {
     // get the reset vector from the rom and
     // set the program counter to the reset vector
@@ -95,47 +286,93 @@ void cpu_reset(void) {
     cycles = 7;
 }
 
-void imp(void) {
+
+// return 1 if there is no cpu called name, 0 otherwise
+int cpu_select(const char* name) {
+    const struct cpu_variant* variants[] = {&nmos, &cmos};
+
+    for (size_t i = 0; i < sizeof(variants) / sizeof(variants[0]); i++) {
+        if (strcmp(variants[i]->name, name) == 0) {
+            variant = variants[i];
+            return 0;
+        }
+    }
+
+    fprintf(stderr, "Unknown cpu %s, expected nmos or 65c02.\n", name);
+    return 1;
+}
+
+// the name of the selected cpu, as given to cpu_select
+const char* cpu_selected(void) {
+    return variant->name;
+}
+
+static void imp(void) {
     addr_mode = ADDR_IMP;
     fetched = a;
 }
 
-void imm(void) {
+static void imm(void) {
     addr_mode = ADDR_IMM;
     fetched = read8(pc++);
 }
 
-void zp(void) {
+static void zp(void) {
     addr_mode = ADDR_ZP;
     absolute_address = read8(pc++);
     fetched = read8(absolute_address);
 }
 
-void zpx(void) {
+static void zpx(void) {
     addr_mode = ADDR_ZPX;
-    absolute_address = read8(pc++) + x;
+    absolute_address = (uint8_t) (read8(pc++) + x);
     fetched = read8(absolute_address);
 }
 
-void zpy(void) {
+static void zpy(void) {
     addr_mode = ADDR_ZPY;
-    absolute_address = read8(pc++) + y;
+    absolute_address = (uint8_t) (read8(pc++) + y);
     fetched = read8(absolute_address);
 }
 
-void rel(void) {
+// the addressing modes ending in w are for the stores, which never read
+// their operand: a read would be seen by a device behind the address
+static void zpw(void) {
+    addr_mode = ADDR_ZP;
+    absolute_address = read8(pc++);
+}
+
+static void zpxw(void) {
+    addr_mode = ADDR_ZPX;
+    absolute_address = (uint8_t) (read8(pc++) + x);
+}
+
+static void zpyw(void) {
+    addr_mode = ADDR_ZPY;
+    absolute_address = (uint8_t) (read8(pc++) + y);
+}
+
+static void rel(void) {
     addr_mode = ADDR_REL;
     int8_t offset = (int8_t) read8(pc++);
     relative_address = pc + offset;
 }
 
-void abso(void) {
+static void abso(void) {
     addr_mode = ADDR_ABSO;
     absolute_address = read16(pc);
+    fetched = read8(absolute_address);
     pc += 2;
 }
 
-void absx(void) {
+// absolute addressing for jumps and stores, which never read their operand
+static void absw(void) {
+    addr_mode = ADDR_ABSO;
+    absolute_address = read16(pc);
+    pc += 2;
+}
+
+static void absx(void) {
     addr_mode = ADDR_ABSX;
     uint16_t base = read16(pc);
     absolute_address = base + x;
@@ -148,7 +385,35 @@ void absx(void) {
     }
 }
 
-void absy(void) {
+// stores and read-modify-write instructions always spend the cycle
+// fixing up the high byte, it is already in their base cycle count
+static void absxm(void) {
+    addr_mode = ADDR_ABSX;
+    absolute_address = read16(pc) + x;
+    fetched = read8(absolute_address);
+    pc += 2;
+}
+
+static void absym(void) {
+    addr_mode = ADDR_ABSY;
+    absolute_address = read16(pc) + y;
+    fetched = read8(absolute_address);
+    pc += 2;
+}
+
+static void absxw(void) {
+    addr_mode = ADDR_ABSX;
+    absolute_address = read16(pc) + x;
+    pc += 2;
+}
+
+static void absyw(void) {
+    addr_mode = ADDR_ABSY;
+    absolute_address = read16(pc) + y;
+    pc += 2;
+}
+
+static void absy(void) {
     addr_mode = ADDR_ABSY;
     uint16_t base = read16(pc);
     absolute_address = base + y;
@@ -161,21 +426,38 @@ void absy(void) {
     }
 }
 
-void ind(void) {
+// the NMOS parts never carry into the high byte of the pointer,
+// JMP ($10FF) reads its target from $10FF and $1000
+static void ind(void) {
+    addr_mode = ADDR_IND;
+    uint16_t pointer = read16(pc);
+    uint8_t lo = read8(pointer);
+    uint8_t hi = read8((pointer & 0xff00) | (uint8_t) (pointer + 1));
+
+    absolute_address = (uint16_t) hi << 8 | lo;
+    pc += 2;
+}
+
+static void ind_cmos(void) {
     addr_mode = ADDR_IND;
     absolute_address = read16(read16(pc));
     pc += 2;
 }
 
-void indx(void) {
+static void indx(void) {
     addr_mode = ADDR_INDX;
-    absolute_address = read16(read8(pc++) + x);
+    absolute_address = read16_zp(read8(pc++) + x);
     fetched = read8(absolute_address);
 }
 
-void indy(void) {
+static void indxw(void) {
+    addr_mode = ADDR_INDX;
+    absolute_address = read16_zp(read8(pc++) + x);
+}
+
+static void indy(void) {
     addr_mode = ADDR_INDY;
-    uint16_t base = read16(read8(pc++));
+    uint16_t base = read16_zp(read8(pc++));
     absolute_address = base + y;
 
     fetched = read8(absolute_address);
@@ -185,54 +467,91 @@ void indy(void) {
     }
 }
 
-void adc(void) {
-    uint16_t temp = a + fetched;
+static void indym(void) {
+    addr_mode = ADDR_INDY;
+    absolute_address = read16_zp(read8(pc++)) + y;
+    fetched = read8(absolute_address);
+}
+
+static void indyw(void) {
+    addr_mode = ADDR_INDY;
+    absolute_address = read16_zp(read8(pc++)) + y;
+}
+
+// 65C02 (zp)
+static void izp(void) {
+    addr_mode = ADDR_IZP;
+    absolute_address = read16_zp(read8(pc++));
+    fetched = read8(absolute_address);
+}
+
+static void izpw(void) {
+    addr_mode = ADDR_IZP;
+    absolute_address = read16_zp(read8(pc++));
+}
+
+// 65C02 JMP ($1234,X)
+static void iax(void) {
+    addr_mode = ADDR_IAX;
+    absolute_address = read16(read16(pc) + x);
+    pc += 2;
+}
+
+// 65C02 BBR and BBS, a zero page byte to test and a branch offset
+static void zpr(void) {
+    addr_mode = ADDR_ZPR;
+    absolute_address = read8(pc++);
+    fetched = read8(absolute_address);
+
+    int8_t offset = (int8_t) read8(pc++);
+    relative_address = pc + offset;
+}
+
+// the read-modify-write instructions leave their result in fetched,
+// so that the undocumented ones can carry on with it
+static void modify(uint8_t value) {
+    fetched = value;
+
+    if (addr_mode == ADDR_IMP) {
+        a = value;
+    } else {
+        write8(absolute_address, value);
+    }
+}
+
+static void adc(void) {
+    uint16_t temp = a + fetched + FLAGSET(FLAG_CARRY);
 
     SETFLAG(FLAG_CARRY, temp > 255)
-    SETFLAG(FLAG_ZERO, temp == 0)
+    SETFLAG(FLAG_ZERO, (temp & 0x00ff) == 0)
     SETFLAG(FLAG_OVERFLOW, (~(a ^ fetched) & (a ^ temp)) & 0x80)
     SETFLAG(FLAG_NEGATIVE, temp & 0x80)
 
     a = temp;
 }
 
-void and(void) {
+static void and(void) {
     a &= fetched;
 
     SETFLAG(FLAG_ZERO, a == 0)
     SETFLAG(FLAG_NEGATIVE, a & 0x80)
 }
 
-void asl(void) {
+static void asl(void) {
     uint16_t temp = fetched << 1;
 
     SETFLAG(FLAG_CARRY, temp & 0xff00)
     SETFLAG(FLAG_ZERO, (temp & 0x00ff) == 0)
     SETFLAG(FLAG_NEGATIVE, temp & 0x80)
 
-    if (addr_mode == ADDR_IMP) {
-        a = temp;
-    } else {
-        write8(absolute_address, temp);
-    }
+    modify(temp);
 }
 
-void bcc(void) {
-    if (FLAGSET(FLAG_CARRY)) {
-        return;
-    }
+// address is the first byte of the branch instruction
+static void branch_at(uint16_t address, int taken) {
+    COVERAGE_BRANCH(address, taken)
 
-    absolute_address = relative_address;
-    if ((absolute_address & 0xff00) != (pc & 0xff00)) {
-        cycles++;
-    }
-
-    cycles++;
-    pc = absolute_address;
-}
-
-void bcs(void) {
-    if (FLAGCLEAR(FLAG_CARRY)) {
+    if (!taken) {
         return;
     }
 
@@ -245,126 +564,83 @@ void bcs(void) {
     pc = absolute_address;
 }
 
-void beq(void) {
-    if (FLAGCLEAR(FLAG_ZERO)) {
-        return;
-    }
-
-    absolute_address = relative_address;
-    if ((absolute_address & 0xff00) != (pc & 0xff00)) {
-        cycles++;
-    }
-
-    cycles++;
-    pc = absolute_address;
+// the pc already points past the branch instruction
+static void branch(int taken) {
+    branch_at(pc - 2, taken);
 }
 
-void bit(void) {
-    uint8_t temp = a & fetched;
-
-    SETFLAG(FLAG_ZERO, temp == 0)
-    SETFLAG(FLAG_NEGATIVE, temp & 0x80)
-    SETFLAG(FLAG_OVERFLOW, temp & 0x40)
+static void bcc(void) {
+    branch(FLAGCLEAR(FLAG_CARRY));
 }
 
-void bmi(void) {
-    if (FLAGCLEAR(FLAG_NEGATIVE)) {
-        return;
-    }
-
-    absolute_address = relative_address;
-    if ((absolute_address & 0xff00) != (pc & 0xff00)) {
-        cycles++;
-    }
+static void bcs(void) {
+    branch(FLAGSET(FLAG_CARRY));
+}
 
-    cycles++;
-    pc = absolute_address;
+static void beq(void) {
+    branch(FLAGSET(FLAG_ZERO));
 }
 
-void bne(void) {
-    if (FLAGSET(FLAG_ZERO)) {
-        return;
-    }
+// the 65C02 BIT #imm only sets the zero flag
+static void bit(void) {
+    SETFLAG(FLAG_ZERO, (a & fetched) == 0)
 
-    absolute_address = relative_address;
-    if ((absolute_address & 0xff00) != (pc & 0xff00)) {
-        cycles++;
+    if (addr_mode != ADDR_IMM) {
+        SETFLAG(FLAG_NEGATIVE, fetched & 0x80)
+        SETFLAG(FLAG_OVERFLOW, fetched & 0x40)
     }
-
-    cycles++;
-    pc = absolute_address;
 }
 
-void bpl(void) {
-    if (FLAGSET(FLAG_NEGATIVE)) {
-        return;
-    }
-
-    absolute_address = relative_address;
-    if ((absolute_address & 0xff00) != (pc & 0xff00)) {
-        cycles++;
-    }
+static void bmi(void) {
+    branch(FLAGSET(FLAG_NEGATIVE));
+}
 
-    cycles++;
-    pc = absolute_address;
+static void bne(void) {
+    branch(FLAGCLEAR(FLAG_ZERO));
 }
 
-void brk(void) {
-    pc++;
+static void bpl(void) {
+    branch(FLAGCLEAR(FLAG_NEGATIVE));
+}
 
-    SETFLAG(FLAG_INTERRUPT, 1)
+// the signature byte after BRK was already skipped by imm
+static void brk(void) {
     push16(pc);
 
     push8(status | FLAG_BREAK);
+    SETFLAG(FLAG_INTERRUPT, 1)
+    status &= variant->interrupt_status;
 
     pc = read16(0xFFFE);
+    cpu_events |= CPU_EVENT_BRK;
+    cpu_brk_count++;
 }
 
-void bvc(void) {
-    if (FLAGSET(FLAG_OVERFLOW)) {
-        return;
-    }
-
-    absolute_address = relative_address;
-    if ((absolute_address & 0xff00) != (pc & 0xff00)) {
-        cycles++;
-    }
-
-    cycles++;
-    pc = absolute_address;
+static void bvc(void) {
+    branch(FLAGCLEAR(FLAG_OVERFLOW));
 }
 
-void bvs(void) {
-    if (FLAGCLEAR(FLAG_OVERFLOW)) {
-        return;
-    }
-
-    absolute_address = relative_address;
-    if ((absolute_address & 0xff00) != (pc & 0xff00)) {
-        cycles++;
-    }
-
-    cycles++;
-    pc = absolute_address;
+static void bvs(void) {
+    branch(FLAGSET(FLAG_OVERFLOW));
 }
 
-void clc(void) {
+static void clc(void) {
     SETFLAG(FLAG_CARRY, 0)
 }
 
-void cld(void) {
+static void cld(void) {
     SETFLAG(FLAG_DECIMAL, 0)
 }
 
-void cli(void) {
+static void cli(void) {
     SETFLAG(FLAG_INTERRUPT, 0)
 }
 
-void clv(void) {
+static void clv(void) {
     SETFLAG(FLAG_OVERFLOW, 0)
 }
 
-void cmp(void) {
+static void cmp(void) {
     uint8_t temp = a - fetched;
 
     SETFLAG(FLAG_CARRY, a >= fetched)
@@ -372,7 +648,7 @@ void cmp(void) {
     SETFLAG(FLAG_NEGATIVE, temp & 0x80)
 }
 
-void cpx(void) {
+static void cpx(void) {
     uint8_t temp = x - fetched;
 
     SETFLAG(FLAG_CARRY, x >= fetched)
@@ -380,7 +656,7 @@ void cpx(void) {
     SETFLAG(FLAG_NEGATIVE, temp & 0x80)
 }
 
-void cpy(void) {
+static void cpy(void) {
     uint8_t temp = y - fetched;
 
     SETFLAG(FLAG_CARRY, y >= fetched)
@@ -388,300 +664,651 @@ void cpy(void) {
     SETFLAG(FLAG_NEGATIVE, temp & 0x80)
 }
 
-void dec(void) {
+static void dec(void) {
     uint8_t temp = fetched - 1;
 
     SETFLAG(FLAG_ZERO, (temp & 0xff) == 0)
     SETFLAG(FLAG_NEGATIVE, temp & 0x80)
 
-    write8(absolute_address, temp);
+    modify(temp);
 }
 
-void dex(void) {
+static void dex(void) {
     x--;
 
     SETFLAG(FLAG_ZERO, (x & 0xff) == 0)
     SETFLAG(FLAG_NEGATIVE, x & 0x80)
 }
 
-void dey(void) {
+static void dey(void) {
     y--;
 
     SETFLAG(FLAG_ZERO, (y & 0xff) == 0)
     SETFLAG(FLAG_NEGATIVE, y & 0x80)
 }
 
-void eor(void) {
+static void eor(void) {
     a ^= fetched;
 
     SETFLAG(FLAG_ZERO, a == 0)
     SETFLAG(FLAG_NEGATIVE, a & 0x80)
 }
 
-void inc(void) {
+static void inc(void) {
     uint8_t temp = fetched + 1;
 
     SETFLAG(FLAG_ZERO, temp == 0)
     SETFLAG(FLAG_NEGATIVE, temp & 0x80)
 
-    write8(absolute_address, temp);
+    modify(temp);
 }
 
-void inx(void) {
+static void inx(void) {
     x++;
 
     SETFLAG(FLAG_ZERO, (x & 0xff) == 0)
     SETFLAG(FLAG_NEGATIVE, x & 0x80)
 }
 
-void iny(void) {
+static void iny(void) {
     y++;
 
-    SETFLAG(FLAG_ZERO, (x & 0xff) == 0)
-    SETFLAG(FLAG_NEGATIVE, x & 0x80)
+    SETFLAG(FLAG_ZERO, (y & 0xff) == 0)
+    SETFLAG(FLAG_NEGATIVE, y & 0x80)
 }
 
-void jmp(void) {
+static void jmp(void) {
     pc = absolute_address;
 }
 
-void jsr(void) {
+static void jsr(void) {
     push16(--pc);
     pc = absolute_address;
 }
 
-void lda(void) {
+static void lda(void) {
     a = fetched;
 
     SETFLAG(FLAG_ZERO, a == 0)
     SETFLAG(FLAG_NEGATIVE, a & 0x80)
 }
 
-void ldx(void) {
+static void ldx(void) {
     x = fetched;
 
     SETFLAG(FLAG_ZERO, x == 0)
     SETFLAG(FLAG_NEGATIVE, x & 0x80)
 }
 
-void ldy(void) {
+static void ldy(void) {
     y = fetched;
 
     SETFLAG(FLAG_ZERO, y == 0)
     SETFLAG(FLAG_NEGATIVE, y & 0x80)
 }
 
-void lsr(void) {
+static void lsr(void) {
     SETFLAG(FLAG_CARRY, fetched & 1)
 
     uint8_t temp = fetched >> 1;
     SETFLAG(FLAG_ZERO, temp == 0)
     SETFLAG(FLAG_NEGATIVE, temp & 0x80)
 
-    if (addr_mode == ADDR_IMP) {
-        a = temp;
-    } else {
-        write8(absolute_address, temp);
-    }
+    modify(temp);
 }
 
-void nop(void) {
+static void nop(void) {
 }
 
-void ora(void) {
+static void ora(void) {
     a |= fetched;
 
     SETFLAG(FLAG_ZERO, a == 0)
     SETFLAG(FLAG_NEGATIVE, a & 0x80)
 }
 
-void pha(void) {
+static void pha(void) {
     push8(a);
 }
 
-void php(void) {
+static void php(void) {
     push8(status | FLAG_BREAK);
 }
 
-void pla(void) {
+static void pla(void) {
     a = pull8();
 
     SETFLAG(FLAG_ZERO, a == 0)
     SETFLAG(FLAG_NEGATIVE, a & 0x80)
 }
 
-void plp(void) {
+static void plp(void) {
     status = pull8();
 }
 
-void rol(void) {
+static void rol(void) {
     uint16_t temp = fetched << 1 | FLAGSET(FLAG_CARRY);
 
     SETFLAG(FLAG_CARRY, temp & 0xff00)
     SETFLAG(FLAG_ZERO, (temp & 0xff) == 0)
     SETFLAG(FLAG_NEGATIVE, temp & 0x80)
 
-    if (addr_mode == ADDR_IMP) {
-        a = temp;
-    } else {
-        write8(absolute_address, temp);
-    }
+    modify(temp);
 }
 
-void ror(void) {
-    uint16_t temp = (FLAGSET(FLAG_CARRY) << 7) | (fetched >> 1);
+static void ror(void) {
+    uint8_t temp = (FLAGSET(FLAG_CARRY) << 7) | (fetched >> 1);
 
-    SETFLAG(FLAG_CARRY, temp & 0xff00)
-    SETFLAG(FLAG_ZERO, (temp & 0xff) == 0)
+    SETFLAG(FLAG_CARRY, fetched & 1)
+    SETFLAG(FLAG_ZERO, temp == 0)
     SETFLAG(FLAG_NEGATIVE, temp & 0x80)
 
-    if (addr_mode == ADDR_IMP) {
-        a = temp;
-    } else {
-        write8(absolute_address, temp);
-    }
+    modify(temp);
 }
 
-void rti(void) {
+static void rti(void) {
     status = pull8();
-    status &= ~FLAG_CARRY;
+    status &= ~FLAG_BREAK;
 
     pc = pull16();
 }
 
-void rts(void) {
+static void rts(void) {
     pc = pull16();
     pc++;
 }
 
-void sbc(void) {
+static void sbc(void) {
     uint16_t value = fetched ^ 0xff;
     uint16_t temp = a + value + FLAGSET(FLAG_CARRY);
 
     SETFLAG(FLAG_CARRY, temp & 0xff00)
     SETFLAG(FLAG_ZERO, (temp & 0x00ff) == 0)
-    SETFLAG(FLAG_OVERFLOW, (~(a ^ fetched) & (a ^ temp)) & 0x80)
+    SETFLAG(FLAG_OVERFLOW, (~(a ^ value) & (a ^ temp)) & 0x80)
     SETFLAG(FLAG_NEGATIVE, temp & 0x80)
 
     a = temp;
 }
 
-void sec(void) {
+static void sec(void) {
     SETFLAG(FLAG_CARRY, 1)
 }
 
-void sed(void) {
+static void sed(void) {
     SETFLAG(FLAG_DECIMAL, 1)
 }
 
-void sei(void) {
+static void sei(void) {
     SETFLAG(FLAG_INTERRUPT, 1)
 }
 
-void sta(void) {
+static void sta(void) {
     write8(absolute_address, a);
 }
 
-void stx(void) {
+static void stx(void) {
     write8(absolute_address, x);
 }
 
-void sty(void) {
+static void sty(void) {
     write8(absolute_address, y);
 }
 
-void tax(void) {
+static void tax(void) {
     x = a;
 
     SETFLAG(FLAG_ZERO, x == 0)
     SETFLAG(FLAG_NEGATIVE, x & 0x80)
 }
 
-void tay(void) {
+static void tay(void) {
     y = a;
 
     SETFLAG(FLAG_ZERO, y == 0)
     SETFLAG(FLAG_NEGATIVE, y & 0x80)
 }
 
-void tsx(void) {
+static void tsx(void) {
     x = sp;
 
     SETFLAG(FLAG_ZERO, x == 0)
     SETFLAG(FLAG_NEGATIVE, x & 0x80)
 }
 
-void txa(void) {
+static void txa(void) {
     a = x;
 
     SETFLAG(FLAG_ZERO, a == 0)
     SETFLAG(FLAG_NEGATIVE, a & 0x80)
 }
 
-void txs(void) {
+static void txs(void) {
     sp = x;
 }
 
-void tya(void) {
+static void tya(void) {
     a = y;
 
     SETFLAG(FLAG_ZERO, a == 0)
     SETFLAG(FLAG_NEGATIVE, a & 0x80)
 }
 
-void (*addr_modes[256])(void) = {
-        imm,  indx, imp, imp, imp, zp,  zp,  imp, imp, imm,  imp, imp, imp,  abso, abso, imp,
-        rel,  indy, imp, imp, imp, zpx, zpx, imp, imp, absy, imp, imp, imp,  absx, absx, imp,
-        abso, indx, imp, imp, zp,  zp,  zp,  imp, imp, imm,  imp, imp, abso, abso, abso, imp,
-        rel,  indy, imp, imp, imp, zpx, zpx, imp, imp, absy, imp, imp, imp,  absx, absx, imp,
-        imp,  indx, imp, imp, imp, zp,  zp,  imp, imp, imm,  imp, imp, abso, abso, abso, imp,
-        rel,  indy, imp, imp, imp, zpx, zpx, imp, imp, absy, imp, imp, imp,  absx, absx, imp,
-        imp,  indx, imp, imp, imp, zp,  zp,  imp, imp, imm,  imp, imp, ind,  abso, abso, imp,
-        rel,  indy, imp, imp, imp, zpx, zpx, imp, imp, absy, imp, imp, imp,  absx, absx, imp,
-        imp,  indx, imp, imp, zp,  zp,  zp,  imp, imp, imp,  imp, imp, abso, abso, abso, imp,
-        rel,  indy, imp, imp, zpx, zpx, zpy, imp, imp, absy, imp, imp, imp,  absx, imp,  imp,
-        imm,  indx, imm, imp, zp,  zp,  zp,  imp, imp, imm,  imp, imp, abso, abso, abso, imp,
-        rel,  indy, imp, imp, zpx, zpx, zpy, imp, imp, absy, imp, imp, absx, absx, absy, imp,
-        imm,  indx, imp, imp, zp,  zp,  zp,  imp, imp, imm,  imp, imp, abso, abso, abso, imp,
-        rel,  indy, imp, imp, imp, zpx, zpx, imp, imp, absy, imp, imp, imp,  absx, absy, imp,
-        imm,  indx, imp, imp, zp,  zp,  zp,  imp, imp, imm,  imp, imp, abso, abso, abso, imp,
-        rel,  indy, imp, imp, imp, zpx, zpx, imp, imp, absy, imp, imp, imp,  absx, absx, imp,
+// undocumented NMOS instructions
+
+static void alr(void) {
+    and();
+    addr_mode = ADDR_IMP;
+    fetched = a;
+    lsr();
+}
+
+static void anc(void) {
+    and();
+    SETFLAG(FLAG_CARRY, a & 0x80)
+}
+
+// unstable on real parts, this is the most common behavior
+static void ane(void) {
+    a = (a | 0xee) & x & fetched;
+
+    SETFLAG(FLAG_ZERO, a == 0)
+    SETFLAG(FLAG_NEGATIVE, a & 0x80)
+}
+
+static void arr(void) {
+    a = (FLAGSET(FLAG_CARRY) << 7) | ((a & fetched) >> 1);
+
+    SETFLAG(FLAG_ZERO, a == 0)
+    SETFLAG(FLAG_NEGATIVE, a & 0x80)
+    SETFLAG(FLAG_CARRY, a & 0x40)
+    SETFLAG(FLAG_OVERFLOW, ((a >> 6) ^ (a >> 5)) & 1)
+}
+
+static void dcp(void) {
+    dec();
+    cmp();
+}
+
+static void isc(void) {
+    inc();
+    sbc();
+}
+
+// the halt opcodes lock the cpu up until a reset
+static void jam(void) {
+    pc--;
+}
+
+static void las(void) {
+    a = x = sp = fetched & sp;
+
+    SETFLAG(FLAG_ZERO, a == 0)
+    SETFLAG(FLAG_NEGATIVE, a & 0x80)
+}
+
+static void lax(void) {
+    lda();
+    x = a;
+}
+
+// unstable on real parts, this is the most common behavior
+static void lxa(void) {
+    a = x = (a | 0xee) & fetched;
+
+    SETFLAG(FLAG_ZERO, a == 0)
+    SETFLAG(FLAG_NEGATIVE, a & 0x80)
+}
+
+static void rla(void) {
+    rol();
+    and();
+}
+
+static void rra(void) {
+    ror();
+    adc();
+}
+
+static void sax(void) {
+    write8(absolute_address, a & x);
+}
+
+static void sbx(void) {
+    uint8_t value = a & x;
+
+    SETFLAG(FLAG_CARRY, value >= fetched)
+    x = value - fetched;
+
+    SETFLAG(FLAG_ZERO, x == 0)
+    SETFLAG(FLAG_NEGATIVE, x & 0x80)
+}
+
+// these store the value ANDed with the high byte of the base address plus one
+static void sha(void) {
+    write8(absolute_address, a & x & (((absolute_address - y) >> 8) + 1));
+}
+
+static void shx(void) {
+    write8(absolute_address, x & (((absolute_address - y) >> 8) + 1));
+}
+
+static void shy(void) {
+    write8(absolute_address, y & (((absolute_address - x) >> 8) + 1));
+}
+
+static void slo(void) {
+    asl();
+    ora();
+}
+
+static void sre(void) {
+    lsr();
+    eor();
+}
+
+static void tas(void) {
+    sp = a & x;
+    write8(absolute_address, sp & (((absolute_address - y) >> 8) + 1));
+}
+
+// 65C02 instructions
+
+// the bit number is in the opcode, BBR0 is $0F and BBR7 is $7F
+static void bbr(void) {
+    branch_at(pc - 3, !(fetched >> (instruction >> 4 & 7) & 1));
+}
+
+static void bbs(void) {
+    branch_at(pc - 3, fetched >> (instruction >> 4 & 7) & 1);
+}
+
+static void bra(void) {
+    branch(1);
+}
+
+static void dea(void) {
+    a--;
+
+    SETFLAG(FLAG_ZERO, a == 0)
+    SETFLAG(FLAG_NEGATIVE, a & 0x80)
+}
+
+static void ina(void) {
+    a++;
+
+    SETFLAG(FLAG_ZERO, a == 0)
+    SETFLAG(FLAG_NEGATIVE, a & 0x80)
+}
+
+static void phx(void) {
+    push8(x);
+}
+
+static void phy(void) {
+    push8(y);
+}
+
+static void plx(void) {
+    x = pull8();
+
+    SETFLAG(FLAG_ZERO, x == 0)
+    SETFLAG(FLAG_NEGATIVE, x & 0x80)
+}
+
+static void ply(void) {
+    y = pull8();
+
+    SETFLAG(FLAG_ZERO, y == 0)
+    SETFLAG(FLAG_NEGATIVE, y & 0x80)
+}
+
+static void rmb(void) {
+    write8(absolute_address, fetched & ~(1 << (instruction >> 4 & 7)));
+}
+
+static void smb(void) {
+    write8(absolute_address, fetched | 1 << (instruction >> 4 & 7));
+}
+
+static void stp(void) {
+    pc--;
+}
+
+static void stz(void) {
+    write8(absolute_address, 0);
+}
+
+static void trb(void) {
+    SETFLAG(FLAG_ZERO, (a & fetched) == 0)
+    write8(absolute_address, fetched & ~a);
+}
+
+static void tsb(void) {
+    SETFLAG(FLAG_ZERO, (a & fetched) == 0)
+    write8(absolute_address, fetched | a);
+}
+
+// wait for an interrupt, cpu_execute takes it before the next opcode
+static void wai(void) {
+    if (!(cpu_irq_lines | cpu_nmi_pending)) {
+        pc--;
+    }
+}
+
+static const struct cpu_variant nmos = {
+        .name = "nmos",
+        .addr_modes = {
+                imm,  indx,  imp, indx,  zp,   zp,   zp,   zp,   imp, imm,   imp, imm,   abso,  abso,  abso,  abso,
+                rel,  indy,  imp, indym, zpx,  zpx,  zpx,  zpx,  imp, absy,  imp, absym, absx,  absx,  absxm, absxm,
+                absw, indx,  imp, indx,  zp,   zp,   zp,   zp,   imp, imm,   imp, imm,   abso,  abso,  abso,  abso,
+                rel,  indy,  imp, indym, zpx,  zpx,  zpx,  zpx,  imp, absy,  imp, absym, absx,  absx,  absxm, absxm,
+                imp,  indx,  imp, indx,  zp,   zp,   zp,   zp,   imp, imm,   imp, imm,   absw,  abso,  abso,  abso,
+                rel,  indy,  imp, indym, zpx,  zpx,  zpx,  zpx,  imp, absy,  imp, absym, absx,  absx,  absxm, absxm,
+                imp,  indx,  imp, indx,  zp,   zp,   zp,   zp,   imp, imm,   imp, imm,   ind,   abso,  abso,  abso,
+                rel,  indy,  imp, indym, zpx,  zpx,  zpx,  zpx,  imp, absy,  imp, absym, absx,  absx,  absxm, absxm,
+                imm,  indxw, imm, indxw, zpw,  zpw,  zpw,  zpw,  imp, imm,   imp, imm,   absw,  absw,  absw,  absw,
+                rel,  indyw, imp, indyw, zpxw, zpxw, zpyw, zpyw, imp, absyw, imp, absyw, absxw, absxw, absyw, absyw,
+                imm,  indx,  imm, indx,  zp,   zp,   zp,   zp,   imp, imm,   imp, imm,   abso,  abso,  abso,  abso,
+                rel,  indy,  imp, indy,  zpx,  zpx,  zpy,  zpy,  imp, absy,  imp, absy,  absx,  absx,  absy,  absy,
+                imm,  indx,  imm, indx,  zp,   zp,   zp,   zp,   imp, imm,   imp, imm,   abso,  abso,  abso,  abso,
+                rel,  indy,  imp, indym, zpx,  zpx,  zpx,  zpx,  imp, absy,  imp, absym, absx,  absx,  absxm, absxm,
+                imm,  indx,  imm, indx,  zp,   zp,   zp,   zp,   imp, imm,   imp, imm,   abso,  abso,  abso,  abso,
+                rel,  indy,  imp, indym, zpx,  zpx,  zpx,  zpx,  imp, absy,  imp, absym, absx,  absx,  absxm, absxm,
+        },
+        .opcodes = {
+                brk, ora, jam, slo, nop, ora, asl, slo, php, ora, asl, anc, nop, ora, asl, slo,
+                bpl, ora, jam, slo, nop, ora, asl, slo, clc, ora, nop, slo, nop, ora, asl, slo,
+                jsr, and, jam, rla, bit, and, rol, rla, plp, and, rol, anc, bit, and, rol, rla,
+                bmi, and, jam, rla, nop, and, rol, rla, sec, and, nop, rla, nop, and, rol, rla,
+                rti, eor, jam, sre, nop, eor, lsr, sre, pha, eor, lsr, alr, jmp, eor, lsr, sre,
+                bvc, eor, jam, sre, nop, eor, lsr, sre, cli, eor, nop, sre, nop, eor, lsr, sre,
+                rts, adc, jam, rra, nop, adc, ror, rra, pla, adc, ror, arr, jmp, adc, ror, rra,
+                bvs, adc, jam, rra, nop, adc, ror, rra, sei, adc, nop, rra, nop, adc, ror, rra,
+                nop, sta, nop, sax, sty, sta, stx, sax, dey, nop, txa, ane, sty, sta, stx, sax,
+                bcc, sta, jam, sha, sty, sta, stx, sax, tya, sta, txs, tas, shy, sta, shx, sha,
+                ldy, lda, ldx, lax, ldy, lda, ldx, lax, tay, lda, tax, lxa, ldy, lda, ldx, lax,
+                bcs, lda, jam, lax, ldy, lda, ldx, lax, clv, lda, tsx, las, ldy, lda, ldx, lax,
+                cpy, cmp, nop, dcp, cpy, cmp, dec, dcp, iny, cmp, dex, sbx, cpy, cmp, dec, dcp,
+                bne, cmp, jam, dcp, nop, cmp, dec, dcp, cld, cmp, nop, dcp, nop, cmp, dec, dcp,
+                cpx, sbc, nop, isc, cpx, sbc, inc, isc, inx, sbc, nop, sbc, cpx, sbc, inc, isc,
+                beq, sbc, jam, isc, nop, sbc, inc, isc, sed, sbc, nop, isc, nop, sbc, inc, isc,
+        },
+        .cycles = {
+                7, 6, 2, 8, 3, 3, 5, 5, 3, 2, 2, 2, 4, 4, 6, 6,
+                2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+                6, 6, 2, 8, 3, 3, 5, 5, 4, 2, 2, 2, 4, 4, 6, 6,
+                2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+                6, 6, 2, 8, 3, 3, 5, 5, 3, 2, 2, 2, 3, 4, 6, 6,
+                2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+                6, 6, 2, 8, 3, 3, 5, 5, 4, 2, 2, 2, 5, 4, 6, 6,
+                2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+                2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 2, 4, 4, 4, 4,
+                2, 6, 2, 6, 4, 4, 4, 4, 2, 5, 2, 5, 5, 5, 5, 5,
+                2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 2, 4, 4, 4, 4,
+                2, 5, 2, 5, 4, 4, 4, 4, 2, 4, 2, 4, 4, 4, 4, 4,
+                2, 6, 2, 8, 3, 3, 5, 5, 2, 2, 2, 2, 4, 4, 6, 6,
+                2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+                2, 6, 2, 8, 3, 3, 5, 5, 2, 2, 2, 2, 4, 4, 6, 6,
+                2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+        },
+        .interrupt_status = 0xff,
 };
 
-void (*opcodes[256])(void) = {
-        brk, ora, nop, nop, nop, ora, asl, nop, php, ora, asl, nop, nop, ora, asl, nop,
-        bpl, ora, nop, nop, nop, ora, asl, nop, clc, ora, nop, nop, nop, ora, asl, nop,
-        jsr, and, nop, nop, bit, and, rol, nop, plp, and, rol, nop, bit, and, rol, nop,
-        bmi, and, nop, nop, nop, and, rol, nop, sec, and, nop, nop, nop, and, rol, nop,
-        rti, eor, nop, nop, nop, eor, lsr, nop, pha, eor, lsr, nop, jmp, eor, lsr, nop,
-        bvc, eor, nop, nop, nop, eor, lsr, nop, cli, eor, nop, nop, nop, eor, lsr, nop,
-        rts, adc, nop, nop, nop, adc, ror, nop, pla, adc, ror, nop, jmp, adc, ror, nop,
-        bvs, adc, nop, nop, nop, adc, ror, nop, sei, adc, nop, nop, nop, adc, ror, nop,
-        nop, sta, nop, nop, sty, sta, stx, nop, dey, nop, txa, nop, sty, sta, stx, nop,
-        bcc, sta, nop, nop, sty, sta, stx, nop, tya, sta, txs, nop, nop, sta, nop, nop,
-        ldy, lda, ldx, nop, ldy, lda, ldx, nop, tay, lda, tax, nop, ldy, lda, ldx, nop,
-        bcs, lda, nop, nop, ldy, lda, ldx, nop, clv, lda, tsx, nop, ldy, lda, ldx, nop,
-        cpy, cmp, nop, nop, cpy, cmp, dec, nop, iny, cmp, dex, nop, cpy, cmp, dec, nop,
-        bne, cmp, nop, nop, nop, cmp, dec, nop, cld, cmp, nop, nop, nop, cmp, dec, nop,
-        cpx, sbc, nop, nop, cpx, sbc, inc, nop, inx, sbc, nop, nop, cpx, sbc, inc, nop,
-        beq, sbc, nop, nop, nop, sbc, inc, nop, sed, sbc, nop, nop, nop, sbc, inc, nop,
+// the undefined opcodes are NOPs of different lengths, and
+// interrupts clear the decimal flag
+static const struct cpu_variant cmos = {
+        .name = "65c02",
+        .addr_modes = {
+                imm,  indx,  imm,  imp, zp,   zp,   zp,   zp, imp, imm,   imp, imp, abso,     abso,  abso,  zpr,
+                rel,  indy,  izp,  imp, zp,   zpx,  zpx,  zp, imp, absy,  imp, imp, abso,     absx,  absx,  zpr,
+                absw, indx,  imm,  imp, zp,   zp,   zp,   zp, imp, imm,   imp, imp, abso,     abso,  abso,  zpr,
+                rel,  indy,  izp,  imp, zpx,  zpx,  zpx,  zp, imp, absy,  imp, imp, absx,     absx,  absx,  zpr,
+                imp,  indx,  imm,  imp, zp,   zp,   zp,   zp, imp, imm,   imp, imp, absw,     abso,  abso,  zpr,
+                rel,  indy,  izp,  imp, zpx,  zpx,  zpx,  zp, imp, absy,  imp, imp, absw,     absx,  absx,  zpr,
+                imp,  indx,  imm,  imp, zpw,  zp,   zp,   zp, imp, imm,   imp, imp, ind_cmos, abso,  abso,  zpr,
+                rel,  indy,  izp,  imp, zpxw, zpx,  zpx,  zp, imp, absy,  imp, imp, iax,      absx,  absx,  zpr,
+                rel,  indxw, imm,  imp, zpw,  zpw,  zpw,  zp, imp, imm,   imp, imp, absw,     absw,  absw,  zpr,
+                rel,  indyw, izpw, imp, zpxw, zpxw, zpyw, zp, imp, absyw, imp, imp, absw,     absxw, absxw, zpr,
+                imm,  indx,  imm,  imp, zp,   zp,   zp,   zp, imp, imm,   imp, imp, abso,     abso,  abso,  zpr,
+                rel,  indy,  izp,  imp, zpx,  zpx,  zpy,  zp, imp, absy,  imp, imp, absx,     absx,  absy,  zpr,
+                imm,  indx,  imm,  imp, zp,   zp,   zp,   zp, imp, imm,   imp, imp, abso,     abso,  abso,  zpr,
+                rel,  indy,  izp,  imp, zpx,  zpx,  zpx,  zp, imp, absy,  imp, imp, absw,     absx,  absxm, zpr,
+                imm,  indx,  imm,  imp, zp,   zp,   zp,   zp, imp, imm,   imp, imp, abso,     abso,  abso,  zpr,
+                rel,  indy,  izp,  imp, zpx,  zpx,  zpx,  zp, imp, absy,  imp, imp, absw,     absx,  absxm, zpr,
+        },
+        .opcodes = {
+                brk, ora, nop, nop, tsb, ora, asl, rmb, php, ora, asl, nop, tsb, ora, asl, bbr,
+                bpl, ora, ora, nop, trb, ora, asl, rmb, clc, ora, ina, nop, trb, ora, asl, bbr,
+                jsr, and, nop, nop, bit, and, rol, rmb, plp, and, rol, nop, bit, and, rol, bbr,
+                bmi, and, and, nop, bit, and, rol, rmb, sec, and, dea, nop, bit, and, rol, bbr,
+                rti, eor, nop, nop, nop, eor, lsr, rmb, pha, eor, lsr, nop, jmp, eor, lsr, bbr,
+                bvc, eor, eor, nop, nop, eor, lsr, rmb, cli, eor, phy, nop, nop, eor, lsr, bbr,
+                rts, adc, nop, nop, stz, adc, ror, rmb, pla, adc, ror, nop, jmp, adc, ror, bbr,
+                bvs, adc, adc, nop, stz, adc, ror, rmb, sei, adc, ply, nop, jmp, adc, ror, bbr,
+                bra, sta, nop, nop, sty, sta, stx, smb, dey, bit, txa, nop, sty, sta, stx, bbs,
+                bcc, sta, sta, nop, sty, sta, stx, smb, tya, sta, txs, nop, stz, sta, stz, bbs,
+                ldy, lda, ldx, nop, ldy, lda, ldx, smb, tay, lda, tax, nop, ldy, lda, ldx, bbs,
+                bcs, lda, lda, nop, ldy, lda, ldx, smb, clv, lda, tsx, nop, ldy, lda, ldx, bbs,
+                cpy, cmp, nop, nop, cpy, cmp, dec, smb, iny, cmp, dex, wai, cpy, cmp, dec, bbs,
+                bne, cmp, cmp, nop, nop, cmp, dec, smb, cld, cmp, phx, stp, nop, cmp, dec, bbs,
+                cpx, sbc, nop, nop, cpx, sbc, inc, smb, inx, sbc, nop, nop, cpx, sbc, inc, bbs,
+                beq, sbc, sbc, nop, nop, sbc, inc, smb, sed, sbc, plx, nop, nop, sbc, inc, bbs,
+        },
+        .cycles = {
+                7, 6, 2, 1, 5, 3, 5, 5, 3, 2, 2, 1, 6, 4, 6, 5,
+                2, 5, 5, 1, 5, 4, 6, 5, 2, 4, 2, 1, 6, 4, 6, 5,
+                6, 6, 2, 1, 3, 3, 5, 5, 4, 2, 2, 1, 4, 4, 6, 5,
+                2, 5, 5, 1, 4, 4, 6, 5, 2, 4, 2, 1, 4, 4, 6, 5,
+                6, 6, 2, 1, 3, 3, 5, 5, 3, 2, 2, 1, 3, 4, 6, 5,
+                2, 5, 5, 1, 4, 4, 6, 5, 2, 4, 3, 1, 8, 4, 6, 5,
+                6, 6, 2, 1, 3, 3, 5, 5, 4, 2, 2, 1, 6, 4, 6, 5,
+                2, 5, 5, 1, 4, 4, 6, 5, 2, 4, 4, 1, 6, 4, 6, 5,
+                3, 6, 2, 1, 3, 3, 3, 5, 2, 2, 2, 1, 4, 4, 4, 5,
+                2, 6, 5, 1, 4, 4, 4, 5, 2, 5, 2, 1, 4, 5, 5, 5,
+                2, 6, 2, 1, 3, 3, 3, 5, 2, 2, 2, 1, 4, 4, 4, 5,
+                2, 5, 5, 1, 4, 4, 4, 5, 2, 4, 2, 1, 4, 4, 4, 5,
+                2, 6, 2, 1, 3, 3, 5, 5, 2, 2, 2, 3, 4, 4, 6, 5,
+                2, 5, 5, 1, 4, 4, 6, 5, 2, 4, 3, 3, 4, 4, 7, 5,
+                2, 6, 2, 1, 3, 3, 5, 5, 2, 2, 2, 1, 4, 4, 6, 5,
+                2, 5, 5, 1, 4, 4, 6, 5, 2, 4, 4, 1, 4, 4, 7, 5,
+        },
+        .interrupt_status = (uint8_t) ~FLAG_DECIMAL,
 };
 
-uint8_t instruction_cycles[256] = {
-        7, 6, 2, 8, 3, 3, 5, 5, 3, 2, 2, 2, 4, 4, 6, 6,
-        2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
-        6, 6, 2, 8, 3, 3, 5, 5, 4, 2, 2, 2, 4, 4, 6, 6,
-        2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
-        6, 6, 2, 8, 3, 3, 5, 5, 3, 2, 2, 2, 3, 4, 6, 6,
-        2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
-        6, 6, 2, 8, 3, 3, 5, 5, 4, 2, 2, 2, 5, 4, 6, 6,
-        2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
-        2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 2, 4, 4, 4, 4,
-        2, 6, 2, 6, 4, 4, 4, 4, 2, 5, 2, 5, 5, 5, 5, 5,
-        2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 2, 4, 4, 4, 4,
-        2, 5, 2, 5, 4, 4, 4, 4, 2, 4, 2, 4, 4, 4, 4, 4,
-        2, 6, 2, 8, 3, 3, 5, 5, 2, 2, 2, 2, 4, 4, 6, 6,
-        2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
-        2, 6, 2, 8, 3, 3, 5, 5, 2, 2, 2, 2, 4, 4, 6, 6,
-        2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7
+static const struct {
+    void (*opcode)(void);
+    const char* name;
+    uint8_t flow;
+} mnemonics[] = {
+        {adc, "ADC", FLOW_NEXT}, {and, "AND", FLOW_NEXT}, {asl, "ASL", FLOW_NEXT}, {bcc, "BCC", FLOW_BRANCH},
+        {bcs, "BCS", FLOW_BRANCH}, {beq, "BEQ", FLOW_BRANCH}, {bit, "BIT", FLOW_NEXT}, {bmi, "BMI", FLOW_BRANCH},
+        {bne, "BNE", FLOW_BRANCH}, {bpl, "BPL", FLOW_BRANCH}, {brk, "BRK", FLOW_RETURN}, {bvc, "BVC", FLOW_BRANCH},
+        {bvs, "BVS", FLOW_BRANCH}, {clc, "CLC", FLOW_NEXT}, {cld, "CLD", FLOW_NEXT}, {cli, "CLI", FLOW_NEXT},
+        {clv, "CLV", FLOW_NEXT}, {cmp, "CMP", FLOW_NEXT}, {cpx, "CPX", FLOW_NEXT}, {cpy, "CPY", FLOW_NEXT},
+        {dec, "DEC", FLOW_NEXT}, {dex, "DEX", FLOW_NEXT}, {dey, "DEY", FLOW_NEXT}, {eor, "EOR", FLOW_NEXT},
+        {inc, "INC", FLOW_NEXT}, {inx, "INX", FLOW_NEXT}, {iny, "INY", FLOW_NEXT}, {jmp, "JMP", FLOW_JUMP},
+        {jsr, "JSR", FLOW_CALL}, {lda, "LDA", FLOW_NEXT}, {ldx, "LDX", FLOW_NEXT}, {ldy, "LDY", FLOW_NEXT},
+        {lsr, "LSR", FLOW_NEXT}, {nop, "NOP", FLOW_NEXT}, {ora, "ORA", FLOW_NEXT}, {pha, "PHA", FLOW_NEXT},
+        {php, "PHP", FLOW_NEXT}, {pla, "PLA", FLOW_NEXT}, {plp, "PLP", FLOW_NEXT}, {rol, "ROL", FLOW_NEXT},
+        {ror, "ROR", FLOW_NEXT}, {rti, "RTI", FLOW_RETURN}, {rts, "RTS", FLOW_RETURN}, {sbc, "SBC", FLOW_NEXT},
+        {sec, "SEC", FLOW_NEXT}, {sed, "SED", FLOW_NEXT}, {sei, "SEI", FLOW_NEXT}, {sta, "STA", FLOW_NEXT},
+        {stx, "STX", FLOW_NEXT}, {sty, "STY", FLOW_NEXT}, {tax, "TAX", FLOW_NEXT}, {tay, "TAY", FLOW_NEXT},
+        {tsx, "TSX", FLOW_NEXT}, {txa, "TXA", FLOW_NEXT}, {txs, "TXS", FLOW_NEXT}, {tya, "TYA", FLOW_NEXT},
+
+        {alr, "ALR", FLOW_NEXT}, {anc, "ANC", FLOW_NEXT}, {ane, "ANE", FLOW_NEXT}, {arr, "ARR", FLOW_NEXT},
+        {dcp, "DCP", FLOW_NEXT}, {isc, "ISC", FLOW_NEXT}, {jam, "JAM", FLOW_RETURN}, {las, "LAS", FLOW_NEXT},
+        {lax, "LAX", FLOW_NEXT}, {lxa, "LXA", FLOW_NEXT}, {rla, "RLA", FLOW_NEXT}, {rra, "RRA", FLOW_NEXT},
+        {sax, "SAX", FLOW_NEXT}, {sbx, "SBX", FLOW_NEXT}, {sha, "SHA", FLOW_NEXT}, {shx, "SHX", FLOW_NEXT},
+        {shy, "SHY", FLOW_NEXT}, {slo, "SLO", FLOW_NEXT}, {sre, "SRE", FLOW_NEXT}, {tas, "TAS", FLOW_NEXT},
+
+        {bbr, "BBR", FLOW_BRANCH}, {bbs, "BBS", FLOW_BRANCH}, {bra, "BRA", FLOW_JUMP}, {dea, "DEC", FLOW_NEXT},
+        {ina, "INC", FLOW_NEXT}, {phx, "PHX", FLOW_NEXT}, {phy, "PHY", FLOW_NEXT}, {plx, "PLX", FLOW_NEXT},
+        {ply, "PLY", FLOW_NEXT}, {rmb, "RMB", FLOW_NEXT}, {smb, "SMB", FLOW_NEXT}, {stp, "STP", FLOW_RETURN},
+        {stz, "STZ", FLOW_NEXT}, {trb, "TRB", FLOW_NEXT}, {tsb, "TSB", FLOW_NEXT}, {wai, "WAI", FLOW_NEXT},
 };
+
+// BBR, BBS, RMB and SMB carry their bit number in the opcode
+static const char* bit_mnemonics[][8] = {
+        {"BBR0", "BBR1", "BBR2", "BBR3", "BBR4", "BBR5", "BBR6", "BBR7"},
+        {"BBS0", "BBS1", "BBS2", "BBS3", "BBS4", "BBS5", "BBS6", "BBS7"},
+        {"RMB0", "RMB1", "RMB2", "RMB3", "RMB4", "RMB5", "RMB6", "RMB7"},
+        {"SMB0", "SMB1", "SMB2", "SMB3", "SMB4", "SMB5", "SMB6", "SMB7"},
+};
+
+static int cpu_describe(uint8_t opcode) {
+    for (size_t i = 0; i < sizeof(mnemonics) / sizeof(mnemonics[0]); i++) {
+        if (mnemonics[i].opcode == variant->opcodes[opcode]) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+// the mnemonics of the selected cpu
+const char* cpu_mnemonic(uint8_t opcode) {
+    void (*operation)(void) = variant->opcodes[opcode];
+    int bit_row = operation == bbr ? 0 : operation == bbs ? 1 : operation == rmb ? 2 : operation == smb ? 3 : -1;
+    if (bit_row != -1) {
+        return bit_mnemonics[bit_row][opcode >> 4 & 7];
+    }
+
+    int i = cpu_describe(opcode);
+    return i == -1 ? "???" : mnemonics[i].name;
+}
+
+// the cycles the instruction takes, without the ones a taken branch adds.
+// crossed is whether its indexed address crossed a page
+uint8_t cpu_cycles(uint8_t opcode, int crossed) {
+    void (*mode)(void) = variant->addr_modes[opcode];
+
+    return variant->cycles[opcode] + (crossed && (mode == absx || mode == absy || mode == indy));
+}
+
+// one of ADDR_*, stores and jumps count as ADDR_ABSO
+uint8_t cpu_mode(uint8_t opcode) {
+    void (*mode)(void) = variant->addr_modes[opcode];
+
+    if (mode == imm) return ADDR_IMM;
+    if (mode == zp || mode == zpw) return ADDR_ZP;
+    if (mode == zpx || mode == zpxw) return ADDR_ZPX;
+    if (mode == zpy || mode == zpyw) return ADDR_ZPY;
+    if (mode == rel) return ADDR_REL;
+    if (mode == abso || mode == absw) return ADDR_ABSO;
+    if (mode == absx || mode == absxm || mode == absxw) return ADDR_ABSX;
+    if (mode == absy || mode == absym || mode == absyw) return ADDR_ABSY;
+    if (mode == ind || mode == ind_cmos) return ADDR_IND;
+    if (mode == indx || mode == indxw) return ADDR_INDX;
+    if (mode == indy || mode == indym || mode == indyw) return ADDR_INDY;
+    if (mode == izp || mode == izpw) return ADDR_IZP;
+    if (mode == iax) return ADDR_IAX;
+    if (mode == zpr) return ADDR_ZPR;
+
+    return ADDR_IMP;
+}
+
+// one of FLOW_*
+uint8_t cpu_flow(uint8_t opcode) {
+    int i = cpu_describe(opcode);
+    return i == -1 ? FLOW_NEXT : mnemonics[i].flow;
+}
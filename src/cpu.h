@@ -3,6 +3,8 @@
 
 #include <stdint.h>
 
+struct memory;
+
 #define FLAG_CARRY (1 << 0)
 #define FLAG_ZERO (1 << 1)
 #define FLAG_INTERRUPT (1 << 2)
@@ -12,6 +14,9 @@
 #define FLAG_OVERFLOW (1 << 6)
 #define FLAG_NEGATIVE (1 << 7)
 
+// the devices that can hold the IRQ line
+#define IRQ_CONSOLE (1 << 0)
+
 #define ADDR_IMP  1
 #define ADDR_IMM  2
 #define ADDR_ZP   3
@@ -24,106 +29,76 @@
 #define ADDR_IND  10
 #define ADDR_INDX 11
 #define ADDR_INDY 12
+#define ADDR_IZP  13 // 65C02 (zp)
+#define ADDR_IAX  14 // 65C02 (abs,X)
+#define ADDR_ZPR  15 // 65C02 zp,rel
+
+// how an instruction moves the program counter
+#define FLOW_NEXT   0
+#define FLOW_BRANCH 1
+#define FLOW_JUMP   2
+#define FLOW_CALL   3
+#define FLOW_RETURN 4 // RTS, RTI, BRK and the halting opcodes
+
+// what happened since cpu_events was last cleared
+#define CPU_EVENT_IRQ (1 << 0)
+#define CPU_EVENT_NMI (1 << 1)
+#define CPU_EVENT_BRK (1 << 2)
+#define CPU_EVENT_STOP (1 << 3) // requested by a device or the host
+
+// why cpu_run returned
+#define CPU_STOP_CYCLES 0
+#define CPU_STOP_PC     1
+#define CPU_STOP_EVENT  2
 
 #define SETFLAG(flag, value) if (value) { status |= flag; } else { status &= ~(flag); }
 #define FLAGSET(flag) ((status & flag) != 0)
 #define FLAGCLEAR(flag) !FLAGSET(flag)
 
-extern uint16_t pc;
-extern uint8_t sp;
-extern uint8_t status;
-extern uint8_t a;
-extern uint8_t x;
-extern uint8_t y;
-
-extern uint8_t instruction;
+// everything needed to resume a machine, taken between two instructions
+struct cpu_state {
+    uint16_t pc;
+    uint8_t sp;
+    uint8_t status;
+    uint8_t a;
+    uint8_t x;
+    uint8_t y;
+    uint8_t cycles;
+    struct memory* memory;
+};
 
 extern uint8_t cpu_memory[0x10000];
 
-uint8_t read8(uint16_t address);
-uint16_t read16(uint16_t address);
+extern uint8_t cpu_events;
 
-void write8(uint16_t address, uint8_t value);
+// counted by both cores since the start, for the metrics
+extern uint64_t cpu_instructions;
+extern uint64_t cpu_irq_count;
+extern uint64_t cpu_nmi_count;
+extern uint64_t cpu_brk_count;
 
-void push16(uint16_t value);
-void push8(uint8_t value);
-
-uint16_t pull16(void);
-uint8_t pull8(void);
+extern uint8_t cpu_irq_lines;
+extern uint8_t cpu_nmi_pending;
 
 void cpu_tick(void);
 void cpu_next_instruction(void);
+uint8_t cpu_step(void);
+int cpu_run(uint64_t* cycles, uint8_t events, int32_t address);
 
 void cpu_reset(void);
+int cpu_select(const char* name);
+const char* cpu_selected(void);
+
+void cpu_irq(uint8_t source, int asserted);
+void cpu_nmi(void);
+
+void cpu_save(struct cpu_state* state);
+void cpu_load(const struct cpu_state* state);
+int cpu_fork(struct cpu_state* child);
 
-void imp(void);
-void imm(void);
-void zp(void);
-void zpx(void);
-void zpy(void);
-void rel(void);
-void abso(void);
-void absx(void);
-void absy(void);
-void ind(void);
-void indx(void);
-void indy(void);
-
-void adc(void);
-void and(void);
-void asl(void);
-void bcc(void);
-void bcs(void);
-void beq(void);
-void bit(void);
-void bmi(void);
-void bne(void);
-void bpl(void);
-void brk(void);
-void bvc(void);
-void bvs(void);
-void clc(void);
-void cld(void);
-void cli(void);
-void clv(void);
-void cmp(void);
-void cpx(void);
-void cpy(void);
-void dec(void);
-void dex(void);
-void dey(void);
-void eor(void);
-void inc(void);
-void inx(void);
-void iny(void);
-void jmp(void);
-void jsr(void);
-void lda(void);
-void ldx(void);
-void ldy(void);
-void lsr(void);
-void nop(void);
-void ora(void);
-void pha(void);
-void php(void);
-void pla(void);
-void plp(void);
-void rol(void);
-void ror(void);
-void rti(void);
-void rts(void);
-void sbc(void);
-void sec(void);
-void sed(void);
-void sei(void);
-void sta(void);
-void stx(void);
-void sty(void);
-void tax(void);
-void tay(void);
-void tsx(void);
-void txa(void);
-void txs(void);
-void tya(void);
+const char* cpu_mnemonic(uint8_t opcode);
+uint8_t cpu_mode(uint8_t opcode);
+uint8_t cpu_cycles(uint8_t opcode, int crossed);
+uint8_t cpu_flow(uint8_t opcode);
 
 #endif
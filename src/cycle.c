@@ -0,0 +1,1002 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "coverage.h"
+#include "cpu.h"
+#include "cycle.h"
+#include "heatmap.h"
+#include "mapper.h"
+#include "memory.h"
+
+// the cycle-exact core. every bus access takes one cycle and happens in
+// the order the NMOS parts do them, dummy reads and writes included.
+// it keeps its own copy of the registers while it runs and hands them
+// back to the fast core between instructions (see cycle_enter)
+
+static uint16_t pc;
+static uint8_t sp;
+static uint8_t status;
+static uint8_t a;
+static uint8_t x;
+static uint8_t y;
+static uint8_t cycles;
+
+static uint8_t opcode = 0;
+
+// the operand, or the value to store
+static uint8_t value = 0;
+
+// the indexed address before the index was added
+static uint16_t base_address = 0;
+
+// whether an interrupt is taken after the running instruction. it is
+// sampled at the start of every cycle, so the last sample is the one
+// the cpu takes at the end of the next to last cycle
+static int interrupt_poll = 0;
+
+uint64_t cycle_clock = 0;
+int cycle_exact = 0;
+
+void (*cycle_probe)(uint64_t cycle, uint16_t address, uint8_t data, uint8_t lines) = NULL;
+
+// CYCLE_LINE_SYNC while the opcode is being fetched
+static uint8_t sync = 0;
+
+// how an instruction drives the bus
+#define KIND_IMPLIED 0
+#define KIND_READ    1
+#define KIND_WRITE   2
+#define KIND_MODIFY  3
+#define KIND_BRANCH  4
+#define KIND_CONTROL 5 // runs a sequence of its own: jumps, the stack and BRK
+
+// built from the mnemonics of the fast core by cycle_init
+static void (*operations[256])(void);
+static uint8_t kinds[256];
+static uint8_t modes[256];
+
+static void poll(void) {
+    interrupt_poll = cpu_nmi_pending || (cpu_irq_lines && FLAGCLEAR(FLAG_INTERRUPT));
+}
+
+static uint8_t read8(uint16_t address) {
+    poll();
+    cycle_clock++;
+
+    // the opcode fetch counts as an execute only
+    if (!sync) {
+        HEATMAP_READ(address)
+    }
+
+    uint8_t* page = memory_active->read_pages[address >> 8];
+    uint8_t data = page ? page[address & 0xff] : memory_read_fault(address);
+
+    if (cycle_probe) {
+        cycle_probe(cycle_clock, address, data, CYCLE_LINE_READ | sync);
+    }
+
+    return data;
+}
+
+static void write8(uint16_t address, uint8_t data) {
+    poll();
+    cycle_clock++;
+    HEATMAP_WRITE(address)
+
+    if (cycle_probe) {
+        cycle_probe(cycle_clock, address, data, 0);
+    }
+
+    uint8_t* page = memory_active->write_pages[address >> 8];
+    if (page) {
+        page[address & 0xff] = data;
+        return;
+    }
+
+    memory_write_fault(address, data);
+}
+
+// the two operand bytes after the opcode
+static uint16_t read16_pc(void) {
+    uint8_t lo = read8(pc++);
+    uint8_t hi = read8(pc++);
+
+    return (uint16_t) hi << 8 | lo;
+}
+
+// a pointer in the zero page wraps around within it
+static uint16_t read16_zp(uint8_t address) {
+    uint8_t lo = read8(address);
+    uint8_t hi = read8((uint8_t) (address + 1));
+
+    return (uint16_t) hi << 8 | lo;
+}
+
+static void push8(uint8_t data) {
+    write8(0x0100 + sp--, data);
+}
+
+static uint8_t pull8(void) {
+    return read8(0x0100 + ++sp);
+}
+
+static void push_pc(void) {
+    push8(pc >> 8);
+    push8(pc & 0xff);
+}
+
+static void jump_to_vector(uint16_t vector) {
+    uint8_t lo = read8(vector);
+    uint8_t hi = read8(vector + 1);
+
+    pc = (uint16_t) hi << 8 | lo;
+}
+
+// the cpu adds the index to the low byte first and fixes up the high
+// byte a cycle later, reading the unfixed address in between. reads skip
+// that cycle when there is nothing to fix, stores and read-modify-write
+// instructions always spend it
+static uint16_t cycle_index(uint8_t index, int fixup) {
+    uint16_t address = base_address + index;
+
+    if (fixup || (address ^ base_address) & 0xff00) {
+        read8((base_address & 0xff00) | (address & 0xff));
+    }
+
+    return address;
+}
+
+// the address of a memory operand, with the dummy reads on the way
+static uint16_t cycle_address(uint8_t mode, int fixup) {
+    uint8_t pointer;
+
+    switch (mode) {
+        case ADDR_ZP:
+            return read8(pc++);
+
+        case ADDR_ZPX:
+        case ADDR_ZPY:
+            pointer = read8(pc++);
+            read8(pointer);
+            return (uint8_t) (pointer + (mode == ADDR_ZPX ? x : y));
+
+        case ADDR_ABSX:
+            base_address = read16_pc();
+            return cycle_index(x, fixup);
+
+        case ADDR_ABSY:
+            base_address = read16_pc();
+            return cycle_index(y, fixup);
+
+        case ADDR_INDX:
+            pointer = read8(pc++);
+            read8(pointer);
+            return read16_zp(pointer + x);
+
+        case ADDR_INDY:
+            base_address = read16_zp(read8(pc++));
+            return cycle_index(y, fixup);
+
+        default:
+            return read16_pc();
+    }
+}
+
+static void setnz(uint8_t result) {
+    SETFLAG(FLAG_ZERO, result == 0)
+    SETFLAG(FLAG_NEGATIVE, result & 0x80)
+}
+
+static void compare(uint8_t reg) {
+    SETFLAG(FLAG_CARRY, reg >= value)
+    setnz(reg - value);
+}
+
+// reads
+
+static void adc(void) {
+    uint16_t temp = a + value + FLAGSET(FLAG_CARRY);
+
+    SETFLAG(FLAG_CARRY, temp > 255)
+    SETFLAG(FLAG_OVERFLOW, (~(a ^ value) & (a ^ temp)) & 0x80)
+    a = temp;
+    setnz(a);
+}
+
+static void and(void) {
+    a &= value;
+    setnz(a);
+}
+
+static void bit(void) {
+    SETFLAG(FLAG_ZERO, (a & value) == 0)
+    SETFLAG(FLAG_NEGATIVE, value & 0x80)
+    SETFLAG(FLAG_OVERFLOW, value & 0x40)
+}
+
+static void cmp(void) {
+    compare(a);
+}
+
+static void cpx(void) {
+    compare(x);
+}
+
+static void cpy(void) {
+    compare(y);
+}
+
+static void eor(void) {
+    a ^= value;
+    setnz(a);
+}
+
+static void lda(void) {
+    a = value;
+    setnz(a);
+}
+
+static void ldx(void) {
+    x = value;
+    setnz(x);
+}
+
+static void ldy(void) {
+    y = value;
+    setnz(y);
+}
+
+static void nop(void) {
+}
+
+static void ora(void) {
+    a |= value;
+    setnz(a);
+}
+
+static void sbc(void) {
+    uint8_t inverted = value ^ 0xff;
+    uint16_t temp = a + inverted + FLAGSET(FLAG_CARRY);
+
+    SETFLAG(FLAG_CARRY, temp & 0xff00)
+    SETFLAG(FLAG_OVERFLOW, (~(a ^ inverted) & (a ^ temp)) & 0x80)
+    a = temp;
+    setnz(a);
+}
+
+static void alr(void) {
+    a &= value;
+    SETFLAG(FLAG_CARRY, a & 1)
+    a >>= 1;
+    setnz(a);
+}
+
+static void anc(void) {
+    and();
+    SETFLAG(FLAG_CARRY, a & 0x80)
+}
+
+static void ane(void) {
+    a = (a | 0xee) & x & value;
+    setnz(a);
+}
+
+static void arr(void) {
+    a = (FLAGSET(FLAG_CARRY) << 7) | ((a & value) >> 1);
+
+    setnz(a);
+    SETFLAG(FLAG_CARRY, a & 0x40)
+    SETFLAG(FLAG_OVERFLOW, ((a >> 6) ^ (a >> 5)) & 1)
+}
+
+static void las(void) {
+    a = x = sp = value & sp;
+    setnz(a);
+}
+
+static void lax(void) {
+    a = x = value;
+    setnz(a);
+}
+
+static void lxa(void) {
+    a = x = (a | 0xee) & value;
+    setnz(a);
+}
+
+static void sbx(void) {
+    uint8_t temp = a & x;
+
+    SETFLAG(FLAG_CARRY, temp >= value)
+    x = temp - value;
+    setnz(x);
+}
+
+// stores, they leave the value to write in value
+
+static void sta(void) {
+    value = a;
+}
+
+static void stx(void) {
+    value = x;
+}
+
+static void sty(void) {
+    value = y;
+}
+
+static void sax(void) {
+    value = a & x;
+}
+
+static void sha(void) {
+    value = a & x & ((base_address >> 8) + 1);
+}
+
+static void shx(void) {
+    value = x & ((base_address >> 8) + 1);
+}
+
+static void shy(void) {
+    value = y & ((base_address >> 8) + 1);
+}
+
+static void tas(void) {
+    sp = a & x;
+    value = sp & ((base_address >> 8) + 1);
+}
+
+// read-modify-write, on value
+
+static void asl(void) {
+    SETFLAG(FLAG_CARRY, value & 0x80)
+    value <<= 1;
+    setnz(value);
+}
+
+static void dec(void) {
+    value--;
+    setnz(value);
+}
+
+static void inc(void) {
+    value++;
+    setnz(value);
+}
+
+static void lsr(void) {
+    SETFLAG(FLAG_CARRY, value & 1)
+    value >>= 1;
+    setnz(value);
+}
+
+static void rol(void) {
+    uint8_t carry = FLAGSET(FLAG_CARRY);
+
+    SETFLAG(FLAG_CARRY, value & 0x80)
+    value = value << 1 | carry;
+    setnz(value);
+}
+
+static void ror(void) {
+    uint8_t carry = FLAGSET(FLAG_CARRY);
+
+    SETFLAG(FLAG_CARRY, value & 1)
+    value = value >> 1 | carry << 7;
+    setnz(value);
+}
+
+static void dcp(void) {
+    dec();
+    cmp();
+}
+
+static void isc(void) {
+    inc();
+    sbc();
+}
+
+static void rla(void) {
+    rol();
+    and();
+}
+
+static void rra(void) {
+    ror();
+    adc();
+}
+
+static void slo(void) {
+    asl();
+    ora();
+}
+
+static void sre(void) {
+    lsr();
+    eor();
+}
+
+// implied
+
+static void clc(void) {
+    SETFLAG(FLAG_CARRY, 0)
+}
+
+static void cld(void) {
+    SETFLAG(FLAG_DECIMAL, 0)
+}
+
+static void cli(void) {
+    SETFLAG(FLAG_INTERRUPT, 0)
+}
+
+static void clv(void) {
+    SETFLAG(FLAG_OVERFLOW, 0)
+}
+
+static void dex(void) {
+    setnz(--x);
+}
+
+static void dey(void) {
+    setnz(--y);
+}
+
+static void inx(void) {
+    setnz(++x);
+}
+
+static void iny(void) {
+    setnz(++y);
+}
+
+static void sec(void) {
+    SETFLAG(FLAG_CARRY, 1)
+}
+
+static void sed(void) {
+    SETFLAG(FLAG_DECIMAL, 1)
+}
+
+static void sei(void) {
+    SETFLAG(FLAG_INTERRUPT, 1)
+}
+
+static void tax(void) {
+    x = a;
+    setnz(x);
+}
+
+static void tay(void) {
+    y = a;
+    setnz(y);
+}
+
+static void tsx(void) {
+    x = sp;
+    setnz(x);
+}
+
+static void txa(void) {
+    a = x;
+    setnz(a);
+}
+
+static void txs(void) {
+    sp = x;
+}
+
+static void tya(void) {
+    a = y;
+    setnz(a);
+}
+
+// branches, they leave whether the branch is taken in value
+
+static void bcc(void) {
+    value = FLAGCLEAR(FLAG_CARRY);
+}
+
+static void bcs(void) {
+    value = FLAGSET(FLAG_CARRY);
+}
+
+static void beq(void) {
+    value = FLAGSET(FLAG_ZERO);
+}
+
+static void bmi(void) {
+    value = FLAGSET(FLAG_NEGATIVE);
+}
+
+static void bne(void) {
+    value = FLAGCLEAR(FLAG_ZERO);
+}
+
+static void bpl(void) {
+    value = FLAGCLEAR(FLAG_NEGATIVE);
+}
+
+static void bvc(void) {
+    value = FLAGCLEAR(FLAG_OVERFLOW);
+}
+
+static void bvs(void) {
+    value = FLAGSET(FLAG_OVERFLOW);
+}
+
+// control, the opcode was fetched and nothing else
+
+static void brk(void) {
+    // the signature byte
+    read8(pc++);
+
+    push_pc();
+    push8(status | FLAG_BREAK);
+    SETFLAG(FLAG_INTERRUPT, 1)
+
+    jump_to_vector(0xFFFE);
+    cpu_events |= CPU_EVENT_BRK;
+    cpu_brk_count++;
+}
+
+// the halt opcodes lock the cpu up until a reset
+static void jam(void) {
+    read8(pc);
+    pc--;
+}
+
+// JMP ($10FF) reads its target from $10FF and $1000
+static void jmp(void) {
+    uint8_t lo = read8(pc++);
+    uint8_t hi = read8(pc);
+
+    if (modes[opcode] == ADDR_IND) {
+        uint16_t pointer = (uint16_t) hi << 8 | lo;
+
+        lo = read8(pointer);
+        hi = read8((pointer & 0xff00) | (uint8_t) (pointer + 1));
+    }
+
+    pc = (uint16_t) hi << 8 | lo;
+}
+
+// the high byte of the target is read last, after the return address went on the stack
+static void jsr(void) {
+    uint8_t lo = read8(pc++);
+    read8(0x0100 + sp);
+    push_pc();
+    uint8_t hi = read8(pc);
+
+    pc = (uint16_t) hi << 8 | lo;
+}
+
+static void pha(void) {
+    read8(pc);
+    push8(a);
+}
+
+static void php(void) {
+    read8(pc);
+    push8(status | FLAG_BREAK);
+}
+
+static void pla(void) {
+    read8(pc);
+    read8(0x0100 + sp);
+    a = pull8();
+    setnz(a);
+}
+
+static void plp(void) {
+    read8(pc);
+    read8(0x0100 + sp);
+    status = pull8();
+}
+
+static void rti(void) {
+    read8(pc);
+    read8(0x0100 + sp);
+    status = pull8() & ~FLAG_BREAK;
+
+    uint8_t lo = pull8();
+    uint8_t hi = pull8();
+    pc = (uint16_t) hi << 8 | lo;
+}
+
+static void rts(void) {
+    read8(pc);
+    read8(0x0100 + sp);
+
+    uint8_t lo = pull8();
+    uint8_t hi = pull8();
+    pc = (uint16_t) hi << 8 | lo;
+    read8(pc++);
+}
+
+static void interrupt(uint16_t vector, uint8_t event) {
+    // the opcode fetch is thrown away
+    sync = CYCLE_LINE_SYNC;
+    read8(pc);
+    sync = 0;
+    read8(pc);
+
+    push_pc();
+    push8((status & ~FLAG_BREAK) | FLAG_UNUSED);
+    SETFLAG(FLAG_INTERRUPT, 1)
+
+    jump_to_vector(vector);
+    cpu_events |= event;
+}
+
+static void branch(void) {
+    int8_t offset = (int8_t) read8(pc++);
+
+    (*operations[opcode])();
+    COVERAGE_BRANCH(pc - 2, value)
+
+    if (!value) {
+        return;
+    }
+
+    uint16_t target = pc + offset;
+    if ((target ^ pc) & 0xff00) {
+        read8(pc);
+        read8((pc & 0xff00) | (target & 0xff));
+    } else {
+        // a taken branch that stays on its page doesn't poll
+        // the interrupts on its last cycle
+        int polled = interrupt_poll;
+        read8(pc);
+        interrupt_poll = polled;
+    }
+
+    pc = target;
+}
+
+// run the next instruction, or take a pending interrupt, a bus access at a time.
+// return the number of cycles it took
+static uint8_t cycle_execute(void) {
+    uint64_t start = cycle_clock;
+
+    if (interrupt_poll) {
+        if (cpu_nmi_pending) {
+            cpu_nmi_pending = 0;
+            interrupt(0xFFFA, CPU_EVENT_NMI);
+            cpu_nmi_count++;
+        } else {
+            interrupt(0xFFFE, CPU_EVENT_IRQ);
+            cpu_irq_count++;
+        }
+
+        return cycle_clock - start;
+    }
+
+    HEATMAP_EXECUTE(pc)
+    COVERAGE_EXECUTE(pc)
+    cpu_instructions++;
+    sync = CYCLE_LINE_SYNC;
+    opcode = read8(pc++);
+    sync = 0;
+
+    uint8_t kind = kinds[opcode];
+    uint8_t mode = modes[opcode];
+
+    if (kind == KIND_CONTROL) {
+        (*operations[opcode])();
+    } else if (kind == KIND_BRANCH) {
+        branch();
+    } else if (mode == ADDR_IMP) {
+        // the byte after the opcode is read and thrown away
+        read8(pc);
+        value = a;
+        (*operations[opcode])();
+
+        if (kind == KIND_MODIFY) {
+            a = value;
+        }
+    } else if (mode == ADDR_IMM) {
+        value = read8(pc++);
+        (*operations[opcode])();
+    } else {
+        uint16_t address = cycle_address(mode, kind != KIND_READ);
+
+        if (kind == KIND_WRITE) {
+            (*operations[opcode])();
+            write8(address, value);
+        } else if (kind == KIND_MODIFY) {
+            // the unmodified value is written back while the alu works
+            value = read8(address);
+            write8(address, value);
+            (*operations[opcode])();
+            write8(address, value);
+        } else {
+            value = read8(address);
+            (*operations[opcode])();
+        }
+    }
+
+    return cycle_clock - start;
+}
+
+static void cycle_enter(void) {
+    struct cpu_state state;
+    cpu_save(&state);
+
+    pc = state.pc;
+    sp = state.sp;
+    status = state.status;
+    a = state.a;
+    x = state.x;
+    y = state.y;
+    cycles = state.cycles;
+}
+
+static void cycle_leave(void) {
+    struct cpu_state state;
+    cpu_save(&state);
+
+    state.pc = pc;
+    state.sp = sp;
+    state.status = status;
+    state.a = a;
+    state.x = x;
+    state.y = y;
+    state.cycles = cycles;
+    cpu_load(&state);
+}
+
+// the accesses of an instruction all happen on its first tick, but
+// in order and counted on cycle_clock, devices can tell them apart
+void cycle_tick(void) {
+    cycle_enter();
+
+    if (cycles != 0) {
+        cycles--;
+    } else {
+        cycles = cycle_execute() - 1;
+    }
+
+    cycle_leave();
+}
+
+// drop what is left of the current instruction and run the next one.
+// return the number of cycles it takes
+uint8_t cycle_step(void) {
+    cycle_enter();
+    uint8_t taken = cycle_execute();
+    cycles = 0;
+    cycle_leave();
+
+    return taken;
+}
+
+// like cpu_run. return the reason the cpu stopped, one of CPU_STOP_*
+int cycle_run(uint64_t* count, uint8_t events, int32_t address) {
+    uint64_t budget = *count;
+    uint64_t elapsed = 0;
+    int reason = CPU_STOP_CYCLES;
+
+    cycle_enter();
+    cpu_events = 0;
+    while (elapsed < budget) {
+        elapsed += cycle_execute();
+
+        if (cpu_events & events) {
+            reason = CPU_STOP_EVENT;
+            break;
+        }
+
+        if (pc == address) {
+            reason = CPU_STOP_PC;
+            break;
+        }
+    }
+
+    cycles = 0;
+    cycle_leave();
+
+    *count = elapsed;
+    return reason;
+}
+
+static const struct {
+    const char* name;
+    uint8_t kind;
+    void (*operation)(void);
+} instructions[] = {
+        {"ADC", KIND_READ, adc}, {"AND", KIND_READ, and}, {"BIT", KIND_READ, bit}, {"CMP", KIND_READ, cmp},
+        {"CPX", KIND_READ, cpx}, {"CPY", KIND_READ, cpy}, {"EOR", KIND_READ, eor}, {"LDA", KIND_READ, lda},
+        {"LDX", KIND_READ, ldx}, {"LDY", KIND_READ, ldy}, {"NOP", KIND_READ, nop}, {"ORA", KIND_READ, ora},
+        {"SBC", KIND_READ, sbc}, {"ALR", KIND_READ, alr}, {"ANC", KIND_READ, anc}, {"ANE", KIND_READ, ane},
+        {"ARR", KIND_READ, arr}, {"LAS", KIND_READ, las}, {"LAX", KIND_READ, lax}, {"LXA", KIND_READ, lxa},
+        {"SBX", KIND_READ, sbx},
+
+        {"STA", KIND_WRITE, sta}, {"STX", KIND_WRITE, stx}, {"STY", KIND_WRITE, sty}, {"SAX", KIND_WRITE, sax},
+        {"SHA", KIND_WRITE, sha}, {"SHX", KIND_WRITE, shx}, {"SHY", KIND_WRITE, shy}, {"TAS", KIND_WRITE, tas},
+
+        {"ASL", KIND_MODIFY, asl}, {"DEC", KIND_MODIFY, dec}, {"INC", KIND_MODIFY, inc}, {"LSR", KIND_MODIFY, lsr},
+        {"ROL", KIND_MODIFY, rol}, {"ROR", KIND_MODIFY, ror}, {"DCP", KIND_MODIFY, dcp}, {"ISC", KIND_MODIFY, isc},
+        {"RLA", KIND_MODIFY, rla}, {"RRA", KIND_MODIFY, rra}, {"SLO", KIND_MODIFY, slo}, {"SRE", KIND_MODIFY, sre},
+
+        {"CLC", KIND_IMPLIED, clc}, {"CLD", KIND_IMPLIED, cld}, {"CLI", KIND_IMPLIED, cli}, {"CLV", KIND_IMPLIED, clv},
+        {"DEX", KIND_IMPLIED, dex}, {"DEY", KIND_IMPLIED, dey}, {"INX", KIND_IMPLIED, inx}, {"INY", KIND_IMPLIED, iny},
+        {"SEC", KIND_IMPLIED, sec}, {"SED", KIND_IMPLIED, sed}, {"SEI", KIND_IMPLIED, sei}, {"TAX", KIND_IMPLIED, tax},
+        {"TAY", KIND_IMPLIED, tay}, {"TSX", KIND_IMPLIED, tsx}, {"TXA", KIND_IMPLIED, txa}, {"TXS", KIND_IMPLIED, txs},
+        {"TYA", KIND_IMPLIED, tya},
+
+        {"BCC", KIND_BRANCH, bcc}, {"BCS", KIND_BRANCH, bcs}, {"BEQ", KIND_BRANCH, beq}, {"BMI", KIND_BRANCH, bmi},
+        {"BNE", KIND_BRANCH, bne}, {"BPL", KIND_BRANCH, bpl}, {"BVC", KIND_BRANCH, bvc}, {"BVS", KIND_BRANCH, bvs},
+
+        {"BRK", KIND_CONTROL, brk}, {"JAM", KIND_CONTROL, jam}, {"JMP", KIND_CONTROL, jmp}, {"JSR", KIND_CONTROL, jsr},
+        {"PHA", KIND_CONTROL, pha}, {"PHP", KIND_CONTROL, php}, {"PLA", KIND_CONTROL, pla}, {"PLP", KIND_CONTROL, plp},
+        {"RTI", KIND_CONTROL, rti}, {"RTS", KIND_CONTROL, rts},
+};
+
+// build the dispatch tables of the selected cpu from the mnemonics and
+// addressing modes of the fast core, so that both decode the same way.
+// return 1 if the cpu has no cycle-exact model, 0 otherwise
+int cycle_init(void) {
+    if (strcmp(cpu_selected(), "nmos") != 0) {
+        fprintf(stderr, "The cycle-exact core only models the nmos cpu.\n");
+        return 1;
+    }
+
+    for (int i = 0; i < 256; i++) {
+        const char* name = cpu_mnemonic(i);
+        size_t j = 0;
+
+        while (j < sizeof(instructions) / sizeof(instructions[0]) && strcmp(instructions[j].name, name) != 0) {
+            j++;
+        }
+
+        if (j == sizeof(instructions) / sizeof(instructions[0])) {
+            fprintf(stderr, "No cycle-exact model of %s.\n", name);
+            return 1;
+        }
+
+        operations[i] = instructions[j].operation;
+        kinds[i] = instructions[j].kind;
+        modes[i] = cpu_mode(i);
+    }
+
+    return 0;
+}
+
+static void cycle_print(const char* core, const struct cpu_state* state, uint8_t taken) {
+    fprintf(stderr, "  %-6s PC=$%04X SP=$%02X A=$%02X X=$%02X Y=$%02X P=$%02X, %u cycles\n",
+            core, state->pc, state->sp, state->a, state->x, state->y, state->status, taken);
+}
+
+// return the first address the two address spaces disagree on, -1 if there is none.
+// only the pages either side wrote since their write pointers were cleared are compared
+static int32_t cycle_compare(const struct memory* left, const struct memory* right) {
+    for (int i = 0; i < MEMORY_PAGE_COUNT; i++) {
+        if (!left->write_pages[i] && !right->write_pages[i]) {
+            continue;
+        }
+
+        if (left->pages[i] == right->pages[i] || !left->pages[i] || !right->pages[i]) {
+            continue;
+        }
+
+        for (int j = 0; j < MEMORY_PAGE_SIZE; j++) {
+            if (left->pages[i][j] != right->pages[i][j]) {
+                return i << 8 | j;
+            }
+        }
+    }
+
+    return -1;
+}
+
+// pages in shared storage (bank windows, host memory) are written
+// straight through by every address space, a fork doesn't separate them.
+// the exact core gets copies of all of them and of the whole physical
+// memory, which stands in for the real one while it runs, so that the
+// banks it switches to are its own too.
+// return the copy of the physical memory, NULL if there is none
+static uint8_t* cycle_separate(struct cpu_state* exact, uint8_t* shared) {
+    uint8_t* physical = NULL;
+
+    if (mapper_physical_size && (physical = malloc(mapper_physical_size))) {
+        memcpy(physical, mapper_physical, mapper_physical_size);
+    }
+
+    cpu_load(exact);
+
+    for (int i = 0; i < MEMORY_PAGE_COUNT; i++) {
+        struct memory* space = exact->memory;
+        uint8_t* data = space->pages[i];
+
+        if (!data || !(space->flags[i] & MEMORY_PAGE_SHARED)) {
+            continue;
+        }
+
+        if (physical && data >= mapper_physical && data < mapper_physical + mapper_physical_size) {
+            memory_map(i, physical + (data - mapper_physical), space->flags[i]);
+        } else {
+            memcpy(shared + i * MEMORY_PAGE_SIZE, data, MEMORY_PAGE_SIZE);
+            memory_map(i, shared + i * MEMORY_PAGE_SIZE, space->flags[i]);
+        }
+    }
+
+    cpu_save(exact);
+    return physical;
+}
+
+// run both cores from the current state for count cycles, each on its own
+// fork of the address space, and compare the registers, the cycles taken
+// and memory after every instruction. devices see the accesses of both,
+// so this is meant for programs that only use memory.
+// return 1 if the cores disagree, 0 otherwise
+int cycle_verify(uint64_t count) {
+    static uint8_t shared[0x10000];
+    struct cpu_state fast;
+    struct cpu_state exact;
+
+    cpu_save(&fast);
+
+    if (cpu_fork(&exact)) {
+        fprintf(stderr, "Could not fork the address space.\n");
+        return 1;
+    }
+
+    uint8_t* physical = cycle_separate(&exact, shared);
+    uint8_t* fast_physical = mapper_physical;
+
+    if (mapper_physical_size && !physical) {
+        fprintf(stderr, "Could not copy the physical memory.\n");
+        memory_free(exact.memory);
+        cpu_load(&fast);
+        return 1;
+    }
+
+    uint64_t elapsed = 0;
+    int failed = 0;
+
+    while (elapsed < count && !failed) {
+        uint16_t address = fast.pc;
+
+        // the first write to each page faults and maps it back,
+        // which leaves the pages the instruction wrote to mapped
+        memset(fast.memory->write_pages, 0, sizeof(fast.memory->write_pages));
+        memset(exact.memory->write_pages, 0, sizeof(exact.memory->write_pages));
+
+        cpu_load(&fast);
+        uint8_t fast_cycles = cpu_step();
+        cpu_save(&fast);
+
+        cpu_load(&exact);
+        mapper_physical = physical;
+        uint8_t exact_cycles = cycle_step();
+        mapper_physical = fast_physical;
+        cpu_save(&exact);
+
+        int32_t difference = cycle_compare(fast.memory, exact.memory);
+        failed = fast.pc != exact.pc || fast.sp != exact.sp || fast.status != exact.status ||
+                 fast.a != exact.a || fast.x != exact.x || fast.y != exact.y ||
+                 fast_cycles != exact_cycles || difference != -1;
+
+        if (failed) {
+            fprintf(stderr, "The cores disagree after %s at $%04X, %llu cycles in.\n",
+                    cpu_mnemonic(memory_peek(address)), address, (unsigned long long) elapsed);
+            cycle_print("fast", &fast, fast_cycles);
+            cycle_print("exact", &exact, exact_cycles);
+
+            if (difference != -1) {
+                fprintf(stderr, "  $%04X holds $%02X on the fast core and $%02X on the exact one\n", difference,
+                        fast.memory->pages[difference >> 8][difference & 0xff],
+                        exact.memory->pages[difference >> 8][difference & 0xff]);
+            }
+        }
+
+        elapsed += fast_cycles;
+    }
+
+    cpu_load(&fast);
+    memory_free(exact.memory);
+    free(physical);
+    return failed;
+}
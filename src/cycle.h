@@ -0,0 +1,29 @@
+#ifndef CURSES6502_CYCLE_H
+#define CURSES6502_CYCLE_H
+
+#include <stdint.h>
+
+// the bus cycles run by the cycle-exact core, one per access. devices
+// can read it to know when exactly they are being accessed
+extern uint64_t cycle_clock;
+
+// the lines of the bus besides the address and the data
+#define CYCLE_LINE_READ (1 << 0) // R/W, low for writes
+#define CYCLE_LINE_SYNC (1 << 1) // high while an opcode is fetched
+
+// when set, sees every bus access of the cycle-exact core as it
+// happens, on the cycle of cycle_clock it happens on
+extern void (*cycle_probe)(uint64_t cycle, uint16_t address, uint8_t data, uint8_t lines);
+
+// set to run the cycle-exact core instead of the fast one
+extern int cycle_exact;
+
+int cycle_init(void);
+
+void cycle_tick(void);
+uint8_t cycle_step(void);
+int cycle_run(uint64_t* count, uint8_t events, int32_t address);
+
+int cycle_verify(uint64_t count);
+
+#endif
@@ -0,0 +1,629 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "cpu.h"
+#include "cycle.h"
+#include "debugger.h"
+#include "memory.h"
+
+#define DEBUGGER_MAX_CLIENTS 16
+#define DEBUGGER_BUFFER_SIZE 0x20000
+
+// a client is only read from while its input has room and its answers
+// don't pile up, and answers are queued for when it is writable again
+struct debugger_client {
+    int fd;
+    uint8_t* input;
+    size_t input_length;
+    uint8_t* output;
+    size_t output_length;
+    size_t output_capacity;
+};
+
+// the batch handed from the server thread to the emulation thread
+struct debugger_batch {
+    int client;
+    uint8_t* requests;
+    size_t request_length;
+    uint8_t* responses;
+    size_t response_length;
+    size_t response_capacity;
+};
+
+uint8_t debugger_breakpoints[0x10000 / 8];
+atomic_int debugger_halted = 0;
+uint64_t debugger_breaks = 0;
+
+// set by the server thread when a batch is ready, cleared by the
+// emulation thread once it has been answered
+atomic_int debugger_pending = 0;
+
+// continuing from a breakpoint must not stop on it again
+int debugger_skip_breakpoint = 0;
+
+struct debugger_client debugger_clients[DEBUGGER_MAX_CLIENTS];
+struct debugger_batch debugger_batch;
+
+int debugger_listener = -1;
+int debugger_epoll = -1;
+int debugger_done_event = -1;
+int debugger_request_event = -1; // a batch was handed over, for debugger_wait
+int debugger_stop_event = -1;
+pthread_t debugger_thread;
+int debugger_running = 0;
+
+uint16_t debugger_get16(const uint8_t* data) {
+    return data[0] | (uint16_t) data[1] << 8;
+}
+
+// where the payload of a response that didn't fit is written and dropped
+uint8_t debugger_discarded[0x10000];
+
+// room for a response without payload is always kept after the last
+// one, so that running out of memory is answered with an error.
+// return where the payload goes
+uint8_t* debugger_respond(uint8_t command, uint8_t status, size_t length) {
+    struct debugger_batch* batch = &debugger_batch;
+    uint8_t* payload = NULL;
+    size_t needed = batch->response_length + 4 + length + 4;
+
+    if (needed > batch->response_capacity) {
+        uint8_t* responses = realloc(batch->responses, needed * 2);
+
+        if (responses) {
+            batch->responses = responses;
+            batch->response_capacity = needed * 2;
+        } else {
+            status = DEBUGGER_ERROR;
+            length = 0;
+            payload = debugger_discarded;
+        }
+    }
+
+    uint8_t* response = batch->responses + batch->response_length;
+    response[0] = command;
+    response[1] = status;
+    response[2] = length & 0xff;
+    response[3] = length >> 8;
+
+    batch->response_length += 4 + length;
+    return payload ? payload : response + 4;
+}
+
+void debugger_respond_pc(uint8_t command) {
+    struct cpu_state state;
+    cpu_save(&state);
+
+    uint8_t* payload = debugger_respond(command, DEBUGGER_OK, 2);
+    payload[0] = state.pc & 0xff;
+    payload[1] = state.pc >> 8;
+}
+
+// runs on the emulation thread, between two instructions
+void debugger_execute(uint8_t command, const uint8_t* payload, uint16_t length) {
+    struct cpu_state state;
+    uint8_t* response;
+
+    cpu_save(&state);
+
+    switch (command) {
+        case DEBUGGER_READ_REGISTERS:
+            response = debugger_respond(command, DEBUGGER_OK, 7);
+            response[0] = state.pc & 0xff;
+            response[1] = state.pc >> 8;
+            response[2] = state.sp;
+            response[3] = state.status;
+            response[4] = state.a;
+            response[5] = state.x;
+            response[6] = state.y;
+            return;
+
+        case DEBUGGER_WRITE_REGISTERS:
+            if (length < 7) {
+                break;
+            }
+
+            state.pc = debugger_get16(payload);
+            state.sp = payload[2];
+            state.status = payload[3];
+            state.a = payload[4];
+            state.x = payload[5];
+            state.y = payload[6];
+            cpu_load(&state);
+            debugger_respond(command, DEBUGGER_OK, 0);
+            return;
+
+        case DEBUGGER_READ_MEMORY:
+            if (length < 4) {
+                break;
+            }
+
+            response = debugger_respond(command, DEBUGGER_OK, debugger_get16(payload + 2));
+            memory_read_block(debugger_get16(payload), response, debugger_get16(payload + 2));
+            return;
+
+        case DEBUGGER_WRITE_MEMORY:
+            if (length < 2) {
+                break;
+            }
+
+            memory_write_block(debugger_get16(payload), payload + 2, length - 2);
+            debugger_respond(command, DEBUGGER_OK, 0);
+            return;
+
+        case DEBUGGER_STEP:
+            if (length < 2) {
+                break;
+            }
+
+            for (int i = 0; i < debugger_get16(payload); i++) {
+                if (cycle_exact) {
+                    cycle_step();
+                } else {
+                    cpu_step();
+                }
+            }
+
+            debugger_halted = 1;
+            debugger_respond_pc(command);
+            return;
+
+        case DEBUGGER_CONTINUE:
+            debugger_skip_breakpoint = 1;
+            debugger_halted = 0;
+            debugger_respond(command, DEBUGGER_OK, 0);
+            return;
+
+        case DEBUGGER_HALT:
+            debugger_halted = 1;
+            debugger_respond_pc(command);
+            return;
+
+        case DEBUGGER_SET_BREAKPOINT:
+        case DEBUGGER_CLEAR_BREAKPOINT:
+            if (length < 2) {
+                break;
+            }
+
+            uint16_t address = debugger_get16(payload);
+            if (command == DEBUGGER_SET_BREAKPOINT) {
+                debugger_breakpoints[address >> 3] |= 1 << (address & 7);
+            } else {
+                debugger_breakpoints[address >> 3] &= ~(1 << (address & 7));
+            }
+
+            debugger_respond(command, DEBUGGER_OK, 0);
+            return;
+
+        case DEBUGGER_STATUS:
+            response = debugger_respond(command, DEBUGGER_OK, 3);
+            response[0] = debugger_halted;
+            response[1] = state.pc & 0xff;
+            response[2] = state.pc >> 8;
+            return;
+    }
+
+    debugger_respond(command, DEBUGGER_ERROR, 0);
+}
+
+// called by the emulation thread before every cpu tick, this is a
+// few loads unless a batch is waiting or a breakpoint is hit
+void debugger_service(void) {
+    struct cpu_state state;
+
+    if (atomic_load_explicit(&debugger_pending, memory_order_acquire)) {
+        struct debugger_batch* batch = &debugger_batch;
+        size_t offset = 0;
+
+        batch->response_length = 0;
+        while (offset + 3 <= batch->request_length) {
+            uint16_t length = debugger_get16(batch->requests + offset + 1);
+            debugger_execute(batch->requests[offset], batch->requests + offset + 3, length);
+            offset += 3 + length;
+        }
+
+        atomic_store_explicit(&debugger_pending, 0, memory_order_release);
+
+        uint64_t one = 1;
+        write(debugger_done_event, &one, sizeof(one));
+    }
+
+    cpu_save(&state);
+    if (state.cycles == 0 && (debugger_breakpoints[state.pc >> 3] >> (state.pc & 7)) & 1) {
+        if (debugger_skip_breakpoint) {
+            debugger_skip_breakpoint = 0;
+        } else {
+            // the service keeps running while halted on the breakpoint
+            debugger_breaks += !debugger_halted;
+            debugger_halted = 1;
+        }
+    } else if (state.cycles == 0) {
+        debugger_skip_breakpoint = 0;
+    }
+}
+
+void debugger_close(struct debugger_client* client) {
+    epoll_ctl(debugger_epoll, EPOLL_CTL_DEL, client->fd, NULL);
+    close(client->fd);
+    client->fd = -1;
+    client->input_length = 0;
+    client->output_length = 0;
+}
+
+// watch for what the client can do next: send while its input has room
+// and its answers were mostly taken, take answers while some are queued
+void debugger_watch(struct debugger_client* client, int index) {
+    struct epoll_event event = {.data.u32 = index};
+
+    if (client->input_length < DEBUGGER_BUFFER_SIZE && client->output_length < DEBUGGER_BUFFER_SIZE) {
+        event.events |= EPOLLIN;
+    }
+
+    if (client->output_length) {
+        event.events |= EPOLLOUT;
+    }
+
+    epoll_ctl(debugger_epoll, EPOLL_CTL_MOD, client->fd, &event);
+}
+
+// send what the socket takes without waiting, the rest stays queued
+void debugger_send(struct debugger_client* client) {
+    size_t sent = 0;
+
+    while (sent < client->output_length) {
+        ssize_t result = send(client->fd, client->output + sent, client->output_length - sent, MSG_NOSIGNAL);
+        if (result == -1 && errno == EINTR) {
+            continue;
+        }
+
+        if (result == -1 && errno == EAGAIN) {
+            break;
+        }
+
+        if (result <= 0) {
+            debugger_close(client);
+            return;
+        }
+
+        sent += result;
+    }
+
+    memmove(client->output, client->output + sent, client->output_length - sent);
+    client->output_length -= sent;
+}
+
+// return 1 if the client had to be dropped, 0 otherwise
+int debugger_queue(struct debugger_client* client, const uint8_t* data, size_t length) {
+    if (client->output_length + length > client->output_capacity) {
+        uint8_t* output = realloc(client->output, (client->output_length + length) * 2);
+        if (!output) {
+            debugger_close(client);
+            return 1;
+        }
+
+        client->output = output;
+        client->output_capacity = (client->output_length + length) * 2;
+    }
+
+    memcpy(client->output + client->output_length, data, length);
+    client->output_length += length;
+    return 0;
+}
+
+// the size of the complete requests at the start of the buffer
+size_t debugger_complete(const struct debugger_client* client) {
+    size_t offset = 0;
+
+    while (offset + 3 <= client->input_length) {
+        size_t length = 3 + debugger_get16(client->input + offset + 1);
+        if (offset + length > client->input_length) {
+            break;
+        }
+
+        offset += length;
+    }
+
+    return offset;
+}
+
+// hand every complete request of the first waiting client to the emulation thread
+void debugger_dispatch(void) {
+    if (atomic_load_explicit(&debugger_pending, memory_order_acquire) || debugger_batch.client != -1) {
+        return;
+    }
+
+    for (int i = 0; i < DEBUGGER_MAX_CLIENTS; i++) {
+        struct debugger_client* client = &debugger_clients[i];
+        size_t complete = client->fd == -1 ? 0 : debugger_complete(client);
+
+        if (complete) {
+            memcpy(debugger_batch.requests, client->input, complete);
+            memmove(client->input, client->input + complete, client->input_length - complete);
+            client->input_length -= complete;
+
+            // the input has room again
+            debugger_watch(client, i);
+
+            debugger_batch.client = i;
+            debugger_batch.request_length = complete;
+            atomic_store_explicit(&debugger_pending, 1, memory_order_release);
+
+            uint64_t one = 1;
+            write(debugger_request_event, &one, sizeof(one));
+            return;
+        }
+    }
+}
+
+void debugger_accept(void) {
+    int fd = accept(debugger_listener, NULL, NULL);
+    if (fd == -1) {
+        return;
+    }
+
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+
+    for (int i = 0; i < DEBUGGER_MAX_CLIENTS; i++) {
+        if (debugger_clients[i].fd == -1) {
+            struct epoll_event event = {.events = EPOLLIN, .data.u32 = i};
+
+            debugger_clients[i].fd = fd;
+            debugger_clients[i].input_length = 0;
+            debugger_clients[i].output_length = 0;
+            epoll_ctl(debugger_epoll, EPOLL_CTL_ADD, fd, &event);
+            return;
+        }
+    }
+
+    close(fd);
+}
+
+// a full buffer of complete requests only waits for the batch before
+// it to be taken, debugger_watch stops reading until then
+void debugger_receive(struct debugger_client* client, int index) {
+    if (client->input_length == DEBUGGER_BUFFER_SIZE) {
+        if (!debugger_complete(client)) {
+            // a single request can't be that large
+            debugger_close(client);
+        }
+
+        return;
+    }
+
+    ssize_t received = recv(client->fd, client->input + client->input_length, DEBUGGER_BUFFER_SIZE - client->input_length, 0);
+    if (received == 0 || (received == -1 && errno != EAGAIN && errno != EINTR)) {
+        debugger_close(client);
+        return;
+    }
+
+    if (received > 0) {
+        client->input_length += received;
+    }
+
+    if (client->input_length == DEBUGGER_BUFFER_SIZE) {
+        debugger_watch(client, index);
+    }
+}
+
+#define DEBUGGER_LISTENER_EVENT 0x100
+#define DEBUGGER_DONE_EVENT 0x101
+#define DEBUGGER_STOP_EVENT 0x102
+
+void* debugger_run(void* argument) {
+    struct epoll_event events[DEBUGGER_MAX_CLIENTS + 3];
+
+    for (;;) {
+        int count = epoll_wait(debugger_epoll, events, DEBUGGER_MAX_CLIENTS + 3, -1);
+
+        for (int i = 0; i < count; i++) {
+            uint32_t source = events[i].data.u32;
+            uint64_t value;
+
+            if (source == DEBUGGER_STOP_EVENT) {
+                return NULL;
+            }
+
+            if (source == DEBUGGER_LISTENER_EVENT) {
+                debugger_accept();
+            } else if (source == DEBUGGER_DONE_EVENT) {
+                read(debugger_done_event, &value, sizeof(value));
+
+                struct debugger_client* client = &debugger_clients[debugger_batch.client];
+                if (client->fd != -1 &&
+                    !debugger_queue(client, debugger_batch.responses, debugger_batch.response_length)) {
+                    debugger_send(client);
+                }
+
+                if (client->fd != -1) {
+                    debugger_watch(client, debugger_batch.client);
+                }
+
+                debugger_batch.client = -1;
+            } else {
+                struct debugger_client* client = &debugger_clients[source];
+
+                // the answers of a client that is gone can't be delivered
+                if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+                    debugger_close(client);
+                    continue;
+                }
+
+                if (events[i].events & EPOLLOUT) {
+                    debugger_send(client);
+                }
+
+                if (client->fd != -1 && events[i].events & EPOLLIN) {
+                    debugger_receive(client, source);
+                }
+
+                if (client->fd != -1) {
+                    debugger_watch(client, source);
+                }
+            }
+        }
+
+        debugger_dispatch();
+    }
+}
+
+// closes and frees whatever debugger_start got to
+void debugger_release(void) {
+    int* fds[] = {&debugger_listener, &debugger_epoll, &debugger_done_event, &debugger_stop_event,
+                  &debugger_request_event};
+
+    for (int i = 0; i < DEBUGGER_MAX_CLIENTS; i++) {
+        if (debugger_clients[i].fd != -1) {
+            close(debugger_clients[i].fd);
+            debugger_clients[i].fd = -1;
+        }
+
+        free(debugger_clients[i].input);
+        free(debugger_clients[i].output);
+        debugger_clients[i].input = NULL;
+        debugger_clients[i].output = NULL;
+    }
+
+    free(debugger_batch.requests);
+    free(debugger_batch.responses);
+    debugger_batch.requests = NULL;
+    debugger_batch.responses = NULL;
+
+    for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++) {
+        if (*fds[i] != -1) {
+            close(*fds[i]);
+            *fds[i] = -1;
+        }
+    }
+}
+
+// endpoint is either a tcp port on localhost or the path of a unix socket.
+// return 1 if the server could not be started, 0 otherwise
+int debugger_start(const char* endpoint) {
+    char* end;
+    long port = strtol(endpoint, &end, 10);
+
+    for (int i = 0; i < DEBUGGER_MAX_CLIENTS; i++) {
+        debugger_clients[i].fd = -1;
+    }
+
+    if (*end == '\0') {
+        struct sockaddr_in address = {
+                .sin_family = AF_INET,
+                .sin_port = htons(port),
+                .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+        };
+        int reuse = 1;
+
+        debugger_listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (debugger_listener == -1 ||
+            setsockopt(debugger_listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) == -1 ||
+            bind(debugger_listener, (struct sockaddr*) &address, sizeof(address)) == -1 ||
+            listen(debugger_listener, DEBUGGER_MAX_CLIENTS) == -1) {
+            fprintf(stderr, "Could not listen on port %ld.\n", port);
+            debugger_release();
+            return 1;
+        }
+    } else {
+        struct sockaddr_un address = {.sun_family = AF_UNIX};
+        struct stat info;
+        strncpy(address.sun_path, endpoint, sizeof(address.sun_path) - 1);
+
+        // a socket left behind by an earlier run is replaced, any other file is not
+        if (lstat(endpoint, &info) == 0 && S_ISSOCK(info.st_mode)) {
+            unlink(endpoint);
+        }
+
+        debugger_listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (debugger_listener == -1 ||
+            bind(debugger_listener, (struct sockaddr*) &address, sizeof(address)) == -1 ||
+            listen(debugger_listener, DEBUGGER_MAX_CLIENTS) == -1) {
+            fprintf(stderr, "Could not listen on %s.\n", endpoint);
+            debugger_release();
+            return 1;
+        }
+    }
+
+    debugger_epoll = epoll_create1(0);
+    debugger_done_event = eventfd(0, EFD_NONBLOCK);
+    debugger_stop_event = eventfd(0, EFD_NONBLOCK);
+    debugger_request_event = eventfd(0, EFD_NONBLOCK);
+
+    struct epoll_event listener = {.events = EPOLLIN, .data.u32 = DEBUGGER_LISTENER_EVENT};
+    struct epoll_event done = {.events = EPOLLIN, .data.u32 = DEBUGGER_DONE_EVENT};
+    struct epoll_event stop = {.events = EPOLLIN, .data.u32 = DEBUGGER_STOP_EVENT};
+
+    if (debugger_epoll == -1 || debugger_done_event == -1 || debugger_stop_event == -1 ||
+        debugger_request_event == -1 ||
+        epoll_ctl(debugger_epoll, EPOLL_CTL_ADD, debugger_listener, &listener) == -1 ||
+        epoll_ctl(debugger_epoll, EPOLL_CTL_ADD, debugger_done_event, &done) == -1 ||
+        epoll_ctl(debugger_epoll, EPOLL_CTL_ADD, debugger_stop_event, &stop) == -1) {
+        fprintf(stderr, "Could not set up the debugger server.\n");
+        debugger_release();
+        return 1;
+    }
+
+    int allocated = 1;
+    for (int i = 0; i < DEBUGGER_MAX_CLIENTS; i++) {
+        debugger_clients[i].input = malloc(DEBUGGER_BUFFER_SIZE);
+        debugger_clients[i].output = NULL;
+        debugger_clients[i].output_capacity = 0;
+        allocated &= debugger_clients[i].input != NULL;
+    }
+
+    // the responses start out with room for the error debugger_respond keeps
+    debugger_batch.client = -1;
+    debugger_batch.requests = malloc(DEBUGGER_BUFFER_SIZE);
+    debugger_batch.responses = malloc(DEBUGGER_BUFFER_SIZE);
+    debugger_batch.response_capacity = DEBUGGER_BUFFER_SIZE;
+
+    if (!allocated || !debugger_batch.requests || !debugger_batch.responses) {
+        fprintf(stderr, "Could not allocate the debugger buffers.\n");
+        debugger_release();
+        return 1;
+    }
+
+    if (pthread_create(&debugger_thread, NULL, debugger_run, NULL)) {
+        fprintf(stderr, "Could not start the debugger server.\n");
+        debugger_release();
+        return 1;
+    }
+
+    debugger_running = 1;
+    return 0;
+}
+
+void debugger_stop(void) {
+    if (!debugger_running) {
+        return;
+    }
+
+    uint64_t one = 1;
+    write(debugger_stop_event, &one, sizeof(one));
+    pthread_join(debugger_thread, NULL);
+
+    debugger_running = 0;
+    debugger_release();
+}
+
+// for the emulation thread while the cpu is halted: sleep until a batch
+// comes in or timeout ms went by, instead of spinning on debugger_service
+void debugger_wait(int timeout) {
+    struct pollfd request = {.fd = debugger_request_event, .events = POLLIN};
+
+    if (poll(&request, 1, timeout) > 0) {
+        uint64_t value;
+        read(debugger_request_event, &value, sizeof(value));
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef CURSES6502_DEBUGGER_H
+#define CURSES6502_DEBUGGER_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+// requests are [command u8][length u16][payload], responses are
+// [command u8][status u8][length u16][payload], little endian.
+// every complete request a client sent is run as one batch between
+// two instructions and answered with a single write
+#define DEBUGGER_READ_REGISTERS 'r'  // -> pc u16, sp, status, a, x, y
+#define DEBUGGER_WRITE_REGISTERS 'R' // pc u16, sp, status, a, x, y
+#define DEBUGGER_READ_MEMORY 'm'     // address u16, length u16 -> bytes
+#define DEBUGGER_WRITE_MEMORY 'M'    // address u16, bytes
+#define DEBUGGER_STEP 's'            // count u16 -> pc u16
+#define DEBUGGER_CONTINUE 'c'
+#define DEBUGGER_HALT 'h'            // -> pc u16
+#define DEBUGGER_SET_BREAKPOINT 'b'  // address u16
+#define DEBUGGER_CLEAR_BREAKPOINT 'B' // address u16
+#define DEBUGGER_STATUS '?'          // -> halted u8, pc u16
+
+#define DEBUGGER_OK 0
+#define DEBUGGER_ERROR 1
+
+extern uint8_t debugger_breakpoints[0x10000 / 8];
+extern atomic_int debugger_halted;
+extern uint64_t debugger_breaks; // the times a breakpoint halted the cpu
+
+int debugger_start(const char* endpoint);
+void debugger_service(void);
+void debugger_wait(int timeout);
+void debugger_stop(void);
+
+#endif
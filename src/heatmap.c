@@ -0,0 +1,58 @@
+#include <stdio.h>
+#include <string.h>
+#include "heatmap.h"
+
+#ifdef CURSES6502_HEATMAP
+
+uint16_t heatmap_reads[0x10000];
+uint16_t heatmap_writes[0x10000];
+uint16_t heatmap_executes[0x10000];
+
+// what the counters were the last time an address was drawn,
+// and how hot it has been recently
+uint16_t heatmap_last[0x10000];
+uint8_t heatmap_heat[0x10000];
+
+// only called for the addresses on screen, so the heat of an address
+// only decays while it is visible
+uint8_t heatmap_decay(uint16_t address) {
+    uint32_t total = heatmap_reads[address] + heatmap_writes[address] + heatmap_executes[address];
+    uint16_t saturated = total > 0xffff ? 0xffff : total;
+
+    uint32_t heat = heatmap_heat[address] - heatmap_heat[address] / 4 + (uint16_t) (saturated - heatmap_last[address]);
+    heatmap_heat[address] = heat > 0xff ? 0xff : heat;
+    heatmap_last[address] = saturated;
+
+    return heatmap_heat[address];
+}
+
+// a .csv path gets one line per accessed address, anything else gets
+// the raw read, write and execute counters one after the other.
+// return 1 if the export failed, 0 otherwise
+int heatmap_export(const char* path) {
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "Could not open %s.\n", path);
+        return 1;
+    }
+
+    size_t length = strlen(path);
+    if (length >= 4 && strcmp(path + length - 4, ".csv") == 0) {
+        fprintf(file, "address,reads,writes,executes\n");
+
+        for (int i = 0; i < 0x10000; i++) {
+            if (heatmap_reads[i] || heatmap_writes[i] || heatmap_executes[i]) {
+                fprintf(file, "%04X,%u,%u,%u\n", i, heatmap_reads[i], heatmap_writes[i], heatmap_executes[i]);
+            }
+        }
+    } else {
+        fwrite(heatmap_reads, sizeof(heatmap_reads), 1, file);
+        fwrite(heatmap_writes, sizeof(heatmap_writes), 1, file);
+        fwrite(heatmap_executes, sizeof(heatmap_executes), 1, file);
+    }
+
+    fclose(file);
+    return 0;
+}
+
+#endif
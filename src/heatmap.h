@@ -0,0 +1,31 @@
+#ifndef CURSES6502_HEATMAP_H
+#define CURSES6502_HEATMAP_H
+
+#include <stdint.h>
+
+#ifdef CURSES6502_HEATMAP
+
+// saturating 16 bit access counters, one per address
+extern uint16_t heatmap_reads[0x10000];
+extern uint16_t heatmap_writes[0x10000];
+extern uint16_t heatmap_executes[0x10000];
+
+#define HEATMAP_COUNT(counters, address) counters[address] += counters[address] != 0xffff;
+
+#define HEATMAP_READ(address) HEATMAP_COUNT(heatmap_reads, address)
+#define HEATMAP_WRITE(address) HEATMAP_COUNT(heatmap_writes, address)
+#define HEATMAP_EXECUTE(address) HEATMAP_COUNT(heatmap_executes, address)
+
+uint8_t heatmap_decay(uint16_t address);
+
+int heatmap_export(const char* path);
+
+#else
+
+#define HEATMAP_READ(address)
+#define HEATMAP_WRITE(address)
+#define HEATMAP_EXECUTE(address)
+
+#endif
+
+#endif
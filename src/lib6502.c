@@ -0,0 +1,152 @@
+#include "cpu.h"
+#include "cycle.h"
+#include "lib6502.h"
+#include "memory.h"
+
+_Static_assert(LIB6502_READONLY == MEMORY_PAGE_READONLY, "page flags out of sync");
+_Static_assert(LIB6502_EVENT_IRQ == CPU_EVENT_IRQ && LIB6502_EVENT_NMI == CPU_EVENT_NMI &&
+               LIB6502_EVENT_BRK == CPU_EVENT_BRK && LIB6502_EVENT_STOP == CPU_EVENT_STOP, "events out of sync");
+_Static_assert(LIB6502_STOP_CYCLES == CPU_STOP_CYCLES && LIB6502_STOP_PC == CPU_STOP_PC &&
+               LIB6502_STOP_EVENT == CPU_STOP_EVENT, "stop reasons out of sync");
+
+struct lib6502_bus lib6502_host;
+uint64_t lib6502_cycle_count = 0;
+
+uint8_t lib6502_bus_read(uint16_t address) {
+    return lib6502_host.read(lib6502_host.context, address);
+}
+
+void lib6502_bus_write(uint16_t address, uint8_t value) {
+    lib6502_host.write(lib6502_host.context, address, value);
+}
+
+// the whole address space starts out on the bus
+void lib6502_init(const struct lib6502_bus* bus) {
+    lib6502_host = *bus;
+    lib6502_cycle_count = 0;
+
+    memory_init();
+    memory_bus_read = lib6502_bus_read;
+    memory_bus_write = lib6502_bus_write;
+
+    lib6502_unmap(0, MEMORY_PAGE_COUNT);
+}
+
+void lib6502_free(void) {
+    memory_free(memory_active);
+}
+
+// map count pages of host RAM starting at page. the cpu reads and writes
+// it directly, without calling the bus, and the host sees every write
+void lib6502_map(uint8_t page, uint16_t count, uint8_t* data, uint8_t flags) {
+    for (uint16_t i = 0; i < count && page + i < MEMORY_PAGE_COUNT; i++) {
+        memory_map(page + i, data + i * MEMORY_PAGE_SIZE, MEMORY_PAGE_SHARED | (flags & LIB6502_READONLY));
+    }
+}
+
+// hand count pages starting at page back to the bus
+void lib6502_unmap(uint8_t page, uint16_t count) {
+    for (uint16_t i = 0; i < count && page + i < MEMORY_PAGE_COUNT; i++) {
+        memory_map(page + i, NULL, 0);
+    }
+}
+
+// cpu is either "nmos" or "65c02", the default is nmos. switching to a
+// cpu without a cycle-exact model goes back to the fast core.
+// return 1 if the cpu is unknown or was left without its exact core, 0 otherwise
+int lib6502_select(const char* cpu) {
+    if (cpu_select(cpu)) {
+        return 1;
+    }
+
+    return cycle_exact && lib6502_exact(1);
+}
+
+// run every bus access on its own cycle, with the dummy reads and writes
+// of the hardware, instead of a whole instruction at once. only the nmos
+// cpu has a cycle-exact model.
+// return 1 if the selected cpu has none, 0 otherwise
+int lib6502_exact(int enabled) {
+    cycle_exact = enabled && !cycle_init();
+    return enabled && !cycle_exact;
+}
+
+void lib6502_reset(void) {
+    struct cpu_state state;
+
+    // the reset sequence is accounted for at once instead of ticked away
+    cpu_reset();
+    cpu_save(&state);
+    lib6502_cycle_count += state.cycles;
+    state.cycles = 0;
+    cpu_load(&state);
+}
+
+// lines is a mask of the devices holding the line low, see cpu_irq
+void lib6502_irq(uint8_t lines, int asserted) {
+    cpu_irq(lines, asserted);
+}
+
+void lib6502_nmi(void) {
+    cpu_nmi();
+}
+
+// end the current run after the running instruction,
+// meant to be called from the bus callbacks
+void lib6502_stop(void) {
+    cpu_events |= CPU_EVENT_STOP;
+}
+
+void lib6502_get_registers(struct lib6502_registers* registers) {
+    struct cpu_state state;
+    cpu_save(&state);
+
+    registers->pc = state.pc;
+    registers->sp = state.sp;
+    registers->status = state.status;
+    registers->a = state.a;
+    registers->x = state.x;
+    registers->y = state.y;
+}
+
+void lib6502_set_registers(const struct lib6502_registers* registers) {
+    struct cpu_state state;
+    cpu_save(&state);
+
+    state.pc = registers->pc;
+    state.sp = registers->sp;
+    state.status = registers->status;
+    state.a = registers->a;
+    state.x = registers->x;
+    state.y = registers->y;
+    cpu_load(&state);
+}
+
+// the number of cycles run since lib6502_init
+uint64_t lib6502_cycles(void) {
+    return lib6502_cycle_count;
+}
+
+// every run goes by whole instructions, so it can overshoot the
+// cycle budget by a few cycles. return one of LIB6502_STOP_*
+int lib6502_run(uint64_t cycles, uint8_t events, int32_t address) {
+    int reason = cycle_exact ? cycle_run(&cycles, events | CPU_EVENT_STOP, address)
+                             : cpu_run(&cycles, events | CPU_EVENT_STOP, address);
+
+    lib6502_cycle_count += cycles;
+    return reason;
+}
+
+int lib6502_run_cycles(uint64_t cycles) {
+    return lib6502_run(cycles, 0, -1);
+}
+
+// the instruction at the current pc always runs, so that
+// running until the same address again goes around a loop
+int lib6502_run_until_pc(uint16_t address, uint64_t cycles) {
+    return lib6502_run(cycles, 0, address);
+}
+
+int lib6502_run_until_event(uint8_t events, uint64_t cycles) {
+    return lib6502_run(cycles, events, -1);
+}
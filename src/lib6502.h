@@ -0,0 +1,66 @@
+#ifndef LIB6502_H
+#define LIB6502_H
+
+#include <stdint.h>
+
+// the public interface of the emulation core, for hosts embedding it.
+// there is one machine per process, like in the curses frontend
+
+// the only names the library exports, the core behind them is hidden
+#define LIB6502_API __attribute__((visibility("default")))
+
+// writes to the pages are dropped
+#define LIB6502_READONLY (1 << 0)
+
+// the events lib6502_run_until_event can stop on
+#define LIB6502_EVENT_IRQ (1 << 0)  // an IRQ was taken
+#define LIB6502_EVENT_NMI (1 << 1)  // an NMI was taken
+#define LIB6502_EVENT_BRK (1 << 2)  // a BRK was executed
+#define LIB6502_EVENT_STOP (1 << 3) // lib6502_stop was called, always stops a run
+
+// why a run returned
+#define LIB6502_STOP_CYCLES 0 // the cycle budget ran out
+#define LIB6502_STOP_PC     1 // the pc reached the requested address
+#define LIB6502_STOP_EVENT  2 // one of the requested events happened
+
+// every access to a page without RAM mapped on it (see lib6502_map)
+// goes through these, with the context given to lib6502_init
+struct lib6502_bus {
+    void* context;
+    uint8_t (*read)(void* context, uint16_t address);
+    void (*write)(void* context, uint16_t address, uint8_t value);
+};
+
+struct lib6502_registers {
+    uint16_t pc;
+    uint8_t sp;
+    uint8_t status;
+    uint8_t a;
+    uint8_t x;
+    uint8_t y;
+};
+
+LIB6502_API void lib6502_init(const struct lib6502_bus* bus);
+LIB6502_API void lib6502_free(void);
+
+LIB6502_API void lib6502_map(uint8_t page, uint16_t count, uint8_t* data, uint8_t flags);
+LIB6502_API void lib6502_unmap(uint8_t page, uint16_t count);
+
+LIB6502_API int lib6502_select(const char* cpu);
+LIB6502_API int lib6502_exact(int enabled);
+
+LIB6502_API void lib6502_reset(void);
+LIB6502_API void lib6502_irq(uint8_t lines, int asserted);
+LIB6502_API void lib6502_nmi(void);
+LIB6502_API void lib6502_stop(void);
+
+LIB6502_API void lib6502_get_registers(struct lib6502_registers* registers);
+LIB6502_API void lib6502_set_registers(const struct lib6502_registers* registers);
+
+LIB6502_API uint64_t lib6502_cycles(void);
+
+LIB6502_API int lib6502_run_cycles(uint64_t cycles);
+LIB6502_API int lib6502_run_until_pc(uint16_t address, uint64_t cycles);
+LIB6502_API int lib6502_run_until_event(uint8_t events, uint64_t cycles);
+
+#endif
@@ -1,25 +1,311 @@
 #include <ncurses.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/param.h>
+#include "analysis.h"
 #include "arguments.h"
+#include "batch.h"
+#include "console.h"
+#include "coverage.h"
 #include "cpu.h"
+#include "cycle.h"
+#include "debugger.h"
+#include "heatmap.h"
+#include "lib6502.h"
+#include "mapper.h"
+#include "memory.h"
+#include "metrics.h"
+#include "reload.h"
+#include "viewer.h"
+#include "waveform.h"
+
+// the rom region is cleared first, so that a shorter file
+// reloaded over a longer one leaves none of the old code behind.
+// it goes straight into the flat image, the devices and the bank
+// windows over the region don't see it
+// return 1 if should abort, 0 otherwise
+int load_bin(void) {
+    static uint8_t image[0x10000];
 
-void load_bin(void) {
     FILE* file = fopen(bin_file, "r");
-    fread(cpu_memory + rom_offset, rom_size, 1, file);
+    if (!file) {
+        fprintf(stderr, "Could not open %s.\n", bin_file);
+        return 1;
+    }
+
+    memset(image, 0, rom_size);
+    fread(image, rom_size, 1, file);
+    int failed = ferror(file);
     fclose(file);
+
+    if (failed) {
+        fprintf(stderr, "Could not read %s.\n", bin_file);
+        return 1;
+    }
+
+    memory_load(rom_offset, image, rom_size);
+    return 0;
 }
 
-int main(int argc, char** argv) {
-    if (arguments_read(argc, argv)) {
-        arguments_free();
-        return EXIT_SUCCESS;
+// whether the last reload failed, shown in the disassembly title
+int reload_failed = 0;
+
+// once the binary file changed, load it over the rom region again. the
+// ram and the registers are left alone, only what was derived from the
+// old code is redone. called between time slices
+void check_reload(void) {
+    if (!reload_poll()) {
+        return;
+    }
+
+    reload_failed = load_bin();
+    if (reload_failed) {
+        fprintf(stderr, "Could not reload %s, the old code keeps running.\n", bin_file);
+        return;
     }
 
-    load_bin();
+    analysis_free();
+    analysis_run();
 
-    cpu_reset();
+    if (hot_reload == RELOAD_RESET) {
+        cpu_reset();
+    }
+}
+
+// return 1 if should abort, 0 otherwise
+int load_banks(void) {
+    if (!physical_size) {
+        return 0;
+    }
+
+    if (mapper_init(physical_size, bank_file)) {
+        return 1;
+    }
+
+    for (int i = 0; i < bank_window_count; i++) {
+        char* end;
+        uint32_t start = strtoul(bank_windows[i], &end, 0);
+        uint32_t size = strtoul(end + (*end == ':'), &end, 0);
+        uint16_t bank_register = strtol(end + (*end == ':'), &end, 0);
+        uint32_t offset = strtoul(end + (*end == ':'), &end, 0);
+        int readonly = strcmp(end, ":rom") == 0;
+
+        if (mapper_add_window(start, size, bank_register, offset, readonly)) {
+            return 1;
+        }
+    }
 
+    return 0;
+}
+
+// split a <file>:<address>:<size> table, the file name can hold colons.
+// return the file name to be freed, NULL if the table is malformed
+char* sweep_table(const char* table, uint16_t* address, uint32_t* size) {
+    char* file = strdup(table);
+    char* last = file ? strrchr(file, ':') : NULL;
+    if (last) {
+        *last = '\0';
+    }
+
+    char* middle = last ? strrchr(file, ':') : NULL;
+    if (!middle || middle == file) {
+        fprintf(stderr, "Malformed table %s, expected <file>:<address>:<size>.\n", table);
+        free(file);
+        return NULL;
+    }
+
+    *middle = '\0';
+    *address = strtol(middle + 1, NULL, 0);
+    *size = strtoul(last + 1, NULL, 0);
+
+    if (!*size || *address + *size > 0x10000) {
+        fprintf(stderr, "The table %s doesn't fit in memory.\n", table);
+        free(file);
+        return NULL;
+    }
+
+    return file;
+}
+
+// write every table of the sweep input into a machine of its own, all
+// forked from the one just reset, run them side by side and append what
+// each left in the output table to the sweep output.
+// return 1 if should abort, 0 otherwise
+int run_sweep(void) {
+    uint16_t address, output_address = 0;
+    uint32_t size, output_size = 0;
+    char* input = sweep_table(sweep_input, &address, &size);
+    char* output = sweep_output ? sweep_table(sweep_output, &output_address, &output_size) : NULL;
+
+    if (!input || (sweep_output && !output)) {
+        free(input);
+        free(output);
+        return 1;
+    }
+
+    FILE* file = fopen(input, "rb");
+    if (!file) {
+        fprintf(stderr, "Could not open %s.\n", input);
+        free(input);
+        free(output);
+        return 1;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    rewind(file);
+
+    int lanes = length / size;
+    uint8_t* tables = malloc(length ? length : 1);
+    if (tables && fread(tables, 1, length, file) != (size_t) length) {
+        lanes = 0;
+    }
+
+    fclose(file);
+
+    struct batch* batch = lanes && tables ? batch_create(lanes) : NULL;
+    if (!batch) {
+        fprintf(stderr, lanes ? "Could not allocate the machines.\n" : "%s holds no whole table.\n", input);
+        free(tables);
+        free(input);
+        free(output);
+        return 1;
+    }
+
+    for (int lane = 0; lane < lanes; lane++) {
+        batch_write(batch, lane, address, tables + (size_t) lane * size, size);
+    }
+
+    batch_run(batch, headless_cycles);
+
+    int failed = 0;
+    if (output) {
+        FILE* results = fopen(output, "ab");
+        uint8_t* buffer = malloc(output_size);
+
+        if (!results || !buffer) {
+            fprintf(stderr, "Could not open %s.\n", output);
+            failed = 1;
+        }
+
+        for (int lane = 0; !failed && lane < lanes; lane++) {
+            batch_read(batch, lane, output_address, buffer, output_size);
+            fwrite(buffer, 1, output_size, results);
+        }
+
+        if (results) {
+            fclose(results);
+        }
+
+        free(buffer);
+    }
+
+    uint64_t steps = batch->vector_steps + batch->scalar_steps;
+    printf("Ran %d machines, %.1f%% of the instructions in lockstep.\n", lanes,
+           steps ? 100.0 * batch->vector_steps / steps : 0.0);
+
+    batch_free(batch);
+    free(tables);
+    free(input);
+    free(output);
+    return failed;
+}
+
+// the bytes the memory viewer changed since the last frame
+uint8_t memory_viewer_shadow[0x10000];
+uint8_t zero_page_shadow[0x10000];
+
+// bytes reachable from the vectors are code, the rest is data
+attr_t analysis_attributes(uint16_t address) {
+    return analysis_map[address] & ANALYSIS_CODE ? A_BOLD :
+           analysis_map[address] & ANALYSIS_POINTER ? A_UNDERLINE : A_NORMAL;
+}
+
+// return 1 if the cpu ran, 0 if it is halted by the debugger
+int run_tick(void) {
+    debugger_service();
+    if (debugger_halted) {
+        return 0;
+    }
+
+    if (cycle_exact) {
+        cycle_tick();
+    } else {
+        cpu_tick();
+    }
+
+    return 1;
+}
+
+void draw_disassembly(WINDOW* disassembly, int lines, int width, uint16_t pc) {
+    // start a third of the window above the program counter
+    uint16_t address = pc;
+    for (int i = 0; i < lines / 3; i++) {
+        address = analysis_previous(address);
+    }
+
+    for (int i = 0; i < lines; i++) {
+        char text[32];
+        char bytes[12] = "";
+        uint8_t length = analysis_disassemble(address, text, sizeof(text));
+        uint8_t flags = analysis_map[address];
+
+        for (int j = 0; j < length; j++) {
+            snprintf(bytes + j * 3, 4, "%02X ", memory_peek(address + j));
+        }
+
+        char marker = address == pc ? '>' :
+                      flags & ANALYSIS_VECTOR ? '*' :
+                      flags & ANALYSIS_SUBROUTINE ? 'S' :
+                      flags & ANALYSIS_BLOCK ? ':' : ' ';
+
+        if (!(flags & ANALYSIS_CODE)) {
+            // not reachable from the vectors, most likely data
+            snprintf(text, sizeof(text), ".byte $%02X", memory_peek(address));
+            snprintf(bytes, sizeof(bytes), "%02X", memory_peek(address));
+            length = 1;
+        }
+
+        mvwprintw(disassembly, i + 1, 1, "%c %04X  %-9s %-*s", marker, address, bytes, width - 20, text);
+        address += length;
+    }
+}
+
+#ifdef CURSES6502_HEATMAP
+#define HEATMAP_WIDTH 18
+
+void draw_heatmap(WINDOW* heatmap, int first_line, int lines) {
+    box(heatmap, 0, 0);
+    mvwprintw(heatmap, 0, 2, "Heatmap");
+
+    for (int i = 0; i < lines; i++) {
+        int address = (first_line + i) * 16;
+
+        for (int j = 0; j < 16; j++) {
+            uint16_t cell = address + j;
+            uint8_t heat = heatmap_decay(cell);
+
+            // show what the address is mostly used for, colored by how busy it is lately
+            chtype c = '.';
+            if (heatmap_executes[cell]) {
+                c = 'x';
+            } else if (heatmap_writes[cell] > heatmap_reads[cell]) {
+                c = 'w';
+            } else if (heatmap_reads[cell]) {
+                c = 'r';
+            }
+
+            int pair = heat == 0 ? 0 : heat < 16 ? 1 : heat < 64 ? 2 : heat < 160 ? 3 : 4;
+            mvwaddch(heatmap, i + 1, j + 1, c | COLOR_PAIR(pair));
+        }
+    }
+}
+#endif
+
+// ns between two polls of the devices by the user interface
+#define UI_POLL_INTERVAL 16000000
+
+void run_ui(void) {
     WINDOW* main_window = initscr();
     timeout(0);
     noecho();
@@ -35,7 +321,19 @@ int main(int argc, char** argv) {
     WINDOW* flags = newwin(5, middle, 0, middle);
     WINDOW* zero_page = newwin(10, middle, 5, middle);
     WINDOW* call_stack = newwin(10, middle, 15, middle);
+#ifdef CURSES6502_HEATMAP
+    start_color();
+    init_pair(1, COLOR_BLUE, COLOR_BLACK);
+    init_pair(2, COLOR_GREEN, COLOR_BLACK);
+    init_pair(3, COLOR_YELLOW, COLOR_BLACK);
+    init_pair(4, COLOR_RED, COLOR_BLACK);
+
+    // the viewer gets whatever the pane leaves of the right half
+    WINDOW* heatmap = newwin(height - 25, HEATMAP_WIDTH, 25, width - HEATMAP_WIDTH);
+    WINDOW* memory_viewer = newwin(height - 25, width - HEATMAP_WIDTH - middle, 25, middle);
+#else
     WINDOW* memory_viewer = newwin(height - 25, middle, 25, middle);
+#endif
     refresh();
 
     scrollok(memory_viewer, TRUE);
@@ -44,11 +342,100 @@ int main(int argc, char** argv) {
     mousemask(ALL_MOUSE_EVENTS, NULL);
 
     int zero_page_first_line = 0;
-    int memory_viewer_first_line = read16(0xFFFC) / 16;
+    int memory_viewer_first_line = (memory_peek(0xFFFC) | memory_peek(0xFFFD) << 8) / 16;
+    int memory_viewer_physical = 0;
+
+    // the first lines the shadow copies were last drawn from
+    int memory_viewer_shown = -1;
+    int zero_page_shown = -1;
+
+    char search_text[VIEWER_MAX_PATTERN * 3 + 1] = "";
+    uint8_t search_pattern[VIEWER_MAX_PATTERN];
+    size_t search_length = 0;
+    uint16_t search_from = 0;
+    int searching = 0;
+    int search_failed = 0;
+
+    uint64_t ticks = 0;
+    uint64_t last_poll = 0;
 
     int c;
     while ((c = getch()) != 'p') {
-        cpu_tick();
+        ticks += run_tick();
+
+        // every pass runs a single cycle, the devices are looked
+        // after at the rate of the screen instead
+        uint64_t now = metrics_clock();
+        if (now - last_poll >= UI_POLL_INTERVAL) {
+            last_poll = now;
+            console_poll();
+            check_reload();
+        }
+
+        struct lib6502_registers registers;
+        lib6502_get_registers(&registers);
+        uint8_t status = registers.status;
+
+        int memory_viewer_lines = memory_viewer_physical ? mapper_physical_size / 16 : 4096;
+
+        // / starts typing a hex pattern, enter searches for it from the
+        // top of the memory viewer and n finds the next match
+        if (searching) {
+            size_t length = strlen(search_text);
+
+            if (c == '\n' || c == KEY_ENTER) {
+                searching = 0;
+                search_length = viewer_parse_pattern(search_text, search_pattern);
+                search_from = memory_viewer_first_line * 16;
+                c = 'n';
+            } else if (c == 27) {
+                searching = 0;
+            } else if ((c == KEY_BACKSPACE || c == 127) && length) {
+                search_text[length - 1] = '\0';
+            } else if (c >= ' ' && c < 127 && length < sizeof(search_text) - 1) {
+                search_text[length] = c;
+                search_text[length + 1] = '\0';
+            }
+
+            werase(memory_viewer);
+        } else if (c == '/') {
+            searching = 1;
+            search_text[0] = '\0';
+            werase(memory_viewer);
+        }
+
+        if (c == 'n' && !searching && !memory_viewer_physical) {
+            uint16_t found;
+
+            search_failed = !viewer_search(search_pattern, search_length, search_from, &found);
+            if (!search_failed) {
+                search_from = found + 1;
+                memory_viewer_first_line = MAX(MIN(found / 16, memory_viewer_lines - (height - 27)), 0);
+            }
+
+            werase(memory_viewer);
+        }
+
+        // b switches the memory viewer between the cpu address space and
+        // the banked physical memory, [ and ] move by one bank in the latter
+        if (c == 'b' && mapper_physical_size && !searching) {
+            memory_viewer_physical = !memory_viewer_physical;
+            memory_viewer_first_line = 0;
+            memory_viewer_shown = -1;
+            werase(memory_viewer);
+        }
+
+        if (memory_viewer_physical && mapper_window_count) {
+            int bank_lines = mapper_windows[0].size / 16;
+
+            if (c == '[') {
+                memory_viewer_first_line = MAX(memory_viewer_first_line - bank_lines, 0);
+            }
+
+            if (c == ']') {
+                memory_viewer_first_line = MAX(MIN(memory_viewer_first_line + bank_lines, memory_viewer_lines - (height - 27)), 0);
+            }
+        }
 
         if (c == KEY_MOUSE) {
             MEVENT event;
@@ -75,7 +462,7 @@ int main(int argc, char** argv) {
                     }
 
                     if (event.x >= middle && event.y >= 25) {
-                        if (memory_viewer_first_line < (4096 - (height - 25))) {
+                        if (memory_viewer_first_line < (memory_viewer_lines - (height - 25))) {
                             memory_viewer_first_line++;
                         }
                     }
@@ -83,51 +470,231 @@ int main(int argc, char** argv) {
             }
         }
 
+        uint64_t frame_start = metrics_clock();
+
         box(disassembly, 0, 0);
         box(flags, 0, 0);
         box(zero_page, 0, 0);
         box(call_stack, 0, 0);
         box(memory_viewer, 0, 0);
 
-        mvwprintw(disassembly, 0, 2, "Disassembly");
+        mvwprintw(disassembly, 0, 2, reload_failed ? "Disassembly (reload failed)" : "Disassembly");
+        draw_disassembly(disassembly, height - 2, middle, registers.pc);
         mvwprintw(flags, 0, 2, "Flags & Registers");
-        mvwprintw(flags, 1, 1, "A: %d   ", a);
-        mvwprintw(flags, 2, 1, "X: %d   ", x);
-        mvwprintw(flags, 3, 1, "Y: %d   ", y);
+        if (debugger_halted) {
+            mvwaddstr(flags, 0, 21, " Halted ");
+        } else {
+            mvwhline(flags, 0, 21, ACS_HLINE, 8);
+        }
+        mvwprintw(flags, 1, 1, "A: %d   ", registers.a);
+        mvwprintw(flags, 2, 1, "X: %d   ", registers.x);
+        mvwprintw(flags, 3, 1, "Y: %d   ", registers.y);
 
-        mvwprintw(flags, 1, 11, "Stack Pointer: %d     ", sp);
-        mvwprintw(flags, 2, 11, "Program Counter: %d     ", pc);
+        mvwprintw(flags, 1, 11, "Stack Pointer: %d     ", registers.sp);
+        mvwprintw(flags, 2, 11, "Program Counter: %d     ", registers.pc);
         mvwprintw(flags, 3, 11, "Flags: C=%d, Z=%d, I=%d, D=%d, B=%d, V=%d, N=%d", FLAGSET(FLAG_CARRY), FLAGSET(FLAG_ZERO), FLAGSET(FLAG_INTERRUPT), FLAGSET(FLAG_DECIMAL), FLAGSET(FLAG_BREAK), FLAGSET(FLAG_OVERFLOW), FLAGSET(FLAG_NEGATIVE));
 
         mvwprintw(zero_page, 0, 2, "Zero-Page");
         mvwprintw(call_stack, 0, 2, "Call Stack");
-        mvwprintw(memory_viewer, 0, 2, "Memory Viewer");
+        if (memory_viewer_physical) {
+            mvwprintw(memory_viewer, 0, 2, "Physical Memory");
 
-        for (int i = 0; i < height - 27; i++) {
-            int address = (memory_viewer_first_line + i) * 16;
-            mvwprintw(memory_viewer, i + 1, 1, "%04X: ", address);
+            for (int i = 0; i < height - 27 && memory_viewer_first_line + i < memory_viewer_lines; i++) {
+                int address = (memory_viewer_first_line + i) * 16;
+                char row[VIEWER_ROW_LENGTH + 1];
 
-            for (int j = 0; j < 16; j++) {
-                mvwprintw(memory_viewer, i + 1, j + (2 * j) + 8 + (j >= 8 ? 1 : 0), "%02X", cpu_memory[address + j]);
+                viewer_format_row(mapper_physical + address, row);
+                mvwprintw(memory_viewer, i + 1, 1, "%05X: %.*s", address, MAX(getmaxx(memory_viewer) - 9, 0), row);
             }
-        }
+        } else {
+            mvwprintw(memory_viewer, 0, 2, "Memory Viewer");
 
-        for (int i = 0; i < 8; i++) {
-            int address = (zero_page_first_line + i) * 16;
-            mvwprintw(zero_page, i + 1, 1, "%04X: ", address);
+            if (memory_viewer_first_line != memory_viewer_shown) {
+                memory_viewer_shown = memory_viewer_first_line;
+                viewer_sync(memory_viewer_first_line * 16, height - 27, memory_viewer_shadow);
+            }
 
-            for (int j = 0; j < 16; j++) {
-                mvwprintw(zero_page, i + 1, j + (2 * j) + 8 + (j >= 8 ? 1 : 0), "%02X", cpu_memory[address + j]);
+            for (int i = 0; i < height - 27; i++) {
+                viewer_draw_row(memory_viewer, i + 1, (memory_viewer_first_line + i) * 16, memory_viewer_shadow, analysis_attributes);
             }
         }
 
+        if (searching) {
+            mvwprintw(memory_viewer, height - 26, 2, "/%s", search_text);
+        } else if (search_failed) {
+            mvwprintw(memory_viewer, height - 26, 2, "Pattern not found");
+        }
+
+        if (zero_page_first_line != zero_page_shown) {
+            zero_page_shown = zero_page_first_line;
+            viewer_sync(zero_page_first_line * 16, 8, zero_page_shadow);
+        }
+
+        for (int i = 0; i < 8; i++) {
+            viewer_draw_row(zero_page, i + 1, (zero_page_first_line + i) * 16, zero_page_shadow, NULL);
+        }
+
         wrefresh(disassembly);
         wrefresh(flags);
         wrefresh(zero_page);
         wrefresh(call_stack);
         wrefresh(memory_viewer);
+
+#ifdef CURSES6502_HEATMAP
+        if (memory_viewer_physical) {
+            werase(heatmap);
+        } else {
+            draw_heatmap(heatmap, memory_viewer_first_line, height - 27);
+        }
+
+        wrefresh(heatmap);
+#endif
+
+        metrics_publish(ticks, metrics_clock() - frame_start);
     }
 
     endwin();
+}
+
+int main(int argc, char** argv) {
+    if (arguments_read(argc, argv)) {
+        arguments_free();
+        return EXIT_SUCCESS;
+    }
+
+    if (cpu_select(cpu_model) || ((exact_bus || verify_cycles) && cycle_init())) {
+        arguments_free();
+        return EXIT_FAILURE;
+    }
+
+    cycle_exact = exact_bus;
+
+    memory_init();
+
+    if (load_bin() || load_banks()) {
+        mapper_free();
+        arguments_free();
+        return EXIT_FAILURE;
+    }
+
+    analysis_run();
+    if (graph_file) {
+        analysis_export(graph_file);
+    }
+
+    cpu_reset();
+
+    if (verify_cycles) {
+        int failed = cycle_verify(verify_cycles);
+        if (!failed) {
+            printf("The cores agree over %ld cycles.\n", verify_cycles);
+        }
+
+        analysis_free();
+        mapper_free();
+        return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    if (sweep_input) {
+        int failed = run_sweep();
+
+        analysis_free();
+        mapper_free();
+        return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    // without the user interface the terminal is free for the console,
+    // with it the console only goes where -T and -X say
+    const char* console_input = console_input_file ? console_input_file : headless_cycles ? "-" : NULL;
+    const char* console_output = console_output_file ? console_output_file : headless_cycles ? "-" : NULL;
+
+    if (console_address != -1 && console_init(console_address, console_output, console_input)) {
+        analysis_free();
+        mapper_free();
+        return EXIT_FAILURE;
+    }
+
+    if (debugger_endpoint && debugger_start(debugger_endpoint)) {
+        analysis_free();
+        mapper_free();
+        return EXIT_FAILURE;
+    }
+
+    if (metrics_file && metrics_open(metrics_file)) {
+        debugger_stop();
+        analysis_free();
+        mapper_free();
+        return EXIT_FAILURE;
+    }
+
+    if (hot_reload != -1 && reload_watch(bin_file)) {
+        metrics_close();
+        debugger_stop();
+        analysis_free();
+        mapper_free();
+        return EXIT_FAILURE;
+    }
+
+    if (waveform_file && waveform_start(waveform_file)) {
+        reload_free();
+        metrics_close();
+        debugger_stop();
+        analysis_free();
+        mapper_free();
+        return EXIT_FAILURE;
+    }
+
+    if (headless_cycles && debugger_endpoint) {
+        // a negative cycle count runs until killed, for the debugger
+        for (long i = 0; headless_cycles < 0 || i < headless_cycles; i += run_tick()) {
+            // a halted cpu runs nothing until the next request, the devices
+            // are still looked after while it waits
+            if (debugger_halted) {
+                debugger_wait(100);
+            }
+
+            if (debugger_halted || (i & 0xffff) == 0) {
+                console_poll();
+                check_reload();
+                metrics_publish(i, 0);
+            }
+        }
+    } else if (headless_cycles) {
+        // nothing needs to look at every tick, run a slice at a time
+        for (long i = 0; headless_cycles < 0 || i < headless_cycles; i += 0x10000) {
+            long slice = headless_cycles < 0 || headless_cycles - i > 0x10000 ? 0x10000 : headless_cycles - i;
+
+            lib6502_run_cycles(slice);
+            console_poll();
+            check_reload();
+            metrics_publish(lib6502_cycles(), 0);
+        }
+    } else {
+        run_ui();
+    }
+
+#ifdef CURSES6502_HEATMAP
+    if (heatmap_file) {
+        heatmap_export(heatmap_file);
+    }
+#endif
+
+#ifdef CURSES6502_COVERAGE
+    if (coverage_file) {
+        coverage_merge_file(coverage_file);
+    }
+
+    if (lcov_file) {
+        coverage_export_lcov(lcov_file, listing_file, bin_file);
+    }
+#endif
+
+    waveform_stop();
+    reload_free();
+    metrics_close();
+    debugger_stop();
+    console_free();
+    analysis_free();
+    mapper_free();
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "mapper.h"
+#include "memory.h"
+
+uint8_t* mapper_physical;
+uint32_t mapper_physical_size = 0;
+
+struct mapper_window mapper_windows[MAPPER_MAX_WINDOWS];
+int mapper_window_count = 0;
+
+void mapper_register_write(uint16_t address, uint8_t value) {
+    for (int i = 0; i < mapper_window_count; i++) {
+        if (mapper_windows[i].bank_register == address) {
+            mapper_select(&mapper_windows[i], value);
+        }
+    }
+}
+
+// return 1 if should abort, 0 otherwise
+int mapper_init(uint32_t physical_size, const char* image) {
+    mapper_physical = calloc(physical_size, 1);
+    if (!mapper_physical) {
+        fprintf(stderr, "Could not allocate %u bytes of physical memory.\n", physical_size);
+        return 1;
+    }
+
+    mapper_physical_size = physical_size;
+
+    if (image) {
+        FILE* file = fopen(image, "r");
+        if (!file) {
+            fprintf(stderr, "Could not open bank image %s.\n", image);
+            return 1;
+        }
+
+        fread(mapper_physical, 1, physical_size, file);
+        fclose(file);
+    }
+
+    return 0;
+}
+
+// return 1 if should abort, 0 otherwise
+int mapper_add_window(uint32_t start, uint32_t size, uint16_t bank_register, uint32_t offset, int readonly) {
+    if (mapper_window_count == MAPPER_MAX_WINDOWS) {
+        fprintf(stderr, "Too many bank windows, at most %d are supported.\n", MAPPER_MAX_WINDOWS);
+        return 1;
+    }
+
+    if (size == 0 || start % MEMORY_PAGE_SIZE || size % MEMORY_PAGE_SIZE) {
+        fprintf(stderr, "Bank window $%04X+$%04X is not page aligned.\n", start, size);
+        return 1;
+    }
+
+    if (start > 0x10000 || size > 0x10000 - start) {
+        fprintf(stderr, "Bank window $%04X+$%04X is outside of the address space.\n", start, size);
+        return 1;
+    }
+
+    if (size > mapper_physical_size || offset > mapper_physical_size - size) {
+        fprintf(stderr, "Bank window $%04X+$%04X is outside of physical memory.\n", start, size);
+        return 1;
+    }
+
+    struct mapper_window* window = &mapper_windows[mapper_window_count++];
+    window->start = start;
+    window->size = size;
+    window->bank_register = bank_register;
+    window->offset = offset;
+    window->bank_count = (mapper_physical_size - offset) / size;
+    window->readonly = readonly;
+
+    struct memory_device device = {
+            .start = bank_register,
+            .end = bank_register,
+            .write = mapper_register_write,
+    };
+    memory_add_device(&device);
+
+    mapper_select(window, 0);
+    return 0;
+}
+
+// re-point the pages of the window, the bank itself is never copied.
+// only the running address space switches: which bank a window shows
+// lives in the page table of each space, not in the window
+void mapper_select(struct mapper_window* window, uint32_t bank) {
+    uint8_t* data = mapper_physical + window->offset + bank % window->bank_count * window->size;
+    uint8_t flags = MEMORY_PAGE_SHARED | (window->readonly ? MEMORY_PAGE_READONLY : 0);
+
+    for (uint32_t i = 0; i < window->size / MEMORY_PAGE_SIZE; i++) {
+        memory_map((window->start >> 8) + i, data + i * MEMORY_PAGE_SIZE, flags);
+    }
+}
+
+void mapper_free(void) {
+    free(mapper_physical);
+}
@@ -0,0 +1,32 @@
+#ifndef CURSES6502_MAPPER_H
+#define CURSES6502_MAPPER_H
+
+#include <stdint.h>
+
+#define MAPPER_MAX_WINDOWS 8
+
+// a range of the cpu address space showing one bank
+// of physical memory at a time
+struct mapper_window {
+    uint16_t start;         // page aligned
+    uint32_t size;          // multiple of the page size, up to the whole address space
+    uint16_t bank_register; // writing N here maps bank N
+    uint32_t offset;        // physical address of bank 0
+    uint32_t bank_count;
+    int readonly;
+};
+
+extern uint8_t* mapper_physical;
+extern uint32_t mapper_physical_size;
+
+extern struct mapper_window mapper_windows[MAPPER_MAX_WINDOWS];
+extern int mapper_window_count;
+
+int mapper_init(uint32_t physical_size, const char* image);
+int mapper_add_window(uint32_t start, uint32_t size, uint16_t bank_register, uint32_t offset, int readonly);
+
+void mapper_select(struct mapper_window* window, uint32_t bank);
+
+void mapper_free(void);
+
+#endif
@@ -0,0 +1,297 @@
+#include <stdlib.h>
+#include <string.h>
+#include "cpu.h"
+#include "memory.h"
+
+struct memory memory_root;
+struct memory* memory_active = &memory_root;
+uint64_t memory_remaps = 0;
+uint64_t memory_read_faults = 0;
+uint64_t memory_write_faults = 0;
+
+// devices are wired to the board, not to an address space,
+// so every fork sees the same ones
+struct memory_device* memory_devices[MEMORY_PAGE_COUNT];
+uint8_t memory_device_reads[MEMORY_PAGE_COUNT];
+uint8_t memory_device_writes[MEMORY_PAGE_COUNT];
+
+// the host bus behind every page mapped without storage
+uint8_t (*memory_bus_read)(uint16_t address);
+void (*memory_bus_write)(uint16_t address, uint8_t value);
+
+// point the cpu paths of a page at its storage, unless
+// a device or the page flags need the slow paths
+void memory_update(struct memory* space, uint8_t page) {
+    uint8_t* data = space->pages[page];
+    memory_remaps++;
+
+    space->read_pages[page] = memory_device_reads[page] ? NULL : data;
+    space->write_pages[page] = memory_device_writes[page] || (space->flags[page] & MEMORY_PAGE_READONLY) ? NULL : data;
+}
+
+void memory_init(void) {
+    // the root address space maps the flat image one to one
+    for (int i = 0; i < MEMORY_PAGE_COUNT; i++) {
+        memory_root.pages[i] = cpu_memory + i * MEMORY_PAGE_SIZE;
+        memory_root.owned_pages[i] = NULL;
+        memory_root.flags[i] = 0;
+        memory_update(&memory_root, i);
+    }
+}
+
+// the child only copies the page table, every page is shared.
+// both the parent and the child lose write access to all the
+// pages so that the next write to any of them gets its own copy
+struct memory* memory_fork(struct memory* parent) {
+    struct memory* child = malloc(sizeof(struct memory));
+    if (!child) {
+        return NULL;
+    }
+
+    memcpy(child->pages, parent->pages, sizeof(parent->pages));
+    memcpy(child->read_pages, parent->read_pages, sizeof(parent->read_pages));
+    memcpy(child->owned_pages, parent->owned_pages, sizeof(parent->owned_pages));
+    memcpy(child->flags, parent->flags, sizeof(parent->flags));
+    memset(child->write_pages, 0, sizeof(child->write_pages));
+    memset(parent->write_pages, 0, sizeof(parent->write_pages));
+
+    child->next = memory_root.next;
+    memory_root.next = child;
+
+    for (int i = 0; i < MEMORY_PAGE_COUNT; i++) {
+        if (child->owned_pages[i]) {
+            child->owned_pages[i]->references++;
+        }
+    }
+
+    return child;
+}
+
+// the root address space can't go away, it is only
+// reset to the flat image. the cpu goes back to it
+void memory_free(struct memory* space) {
+    for (int i = 0; i < MEMORY_PAGE_COUNT; i++) {
+        struct memory_page* page = space->owned_pages[i];
+        if (page && --page->references == 0) {
+            free(page);
+        }
+
+        space->owned_pages[i] = NULL;
+    }
+
+    if (memory_active == space) {
+        memory_active = &memory_root;
+    }
+
+    if (space == &memory_root) {
+        memory_init();
+
+        // the forks still share the flat image with it
+        if (memory_root.next) {
+            memset(memory_root.write_pages, 0, sizeof(memory_root.write_pages));
+        }
+
+        return;
+    }
+
+    for (struct memory* other = &memory_root; other; other = other->next) {
+        if (other->next == space) {
+            other->next = space->next;
+            break;
+        }
+    }
+
+    free(space);
+}
+
+// point a page of the running address space at external storage,
+// without copying it. a NULL data hands the page to the host bus
+void memory_map(uint8_t page, uint8_t* data, uint8_t flags) {
+    struct memory_page* owned = memory_active->owned_pages[page];
+    if (owned && --owned->references == 0) {
+        free(owned);
+    }
+
+    memory_active->pages[page] = data;
+    memory_active->owned_pages[page] = NULL;
+    memory_active->flags[page] = flags;
+    memory_update(memory_active, page);
+}
+
+void memory_add_device(struct memory_device* device) {
+    for (int i = device->start >> 8; i <= device->end >> 8; i++) {
+        struct memory_device* node = malloc(sizeof(struct memory_device));
+        if (!node) {
+            abort();
+        }
+
+        *node = *device;
+        node->next = memory_devices[i];
+        memory_devices[i] = node;
+
+        memory_device_reads[i] |= device->read != NULL;
+        memory_device_writes[i] |= device->write != NULL;
+
+        // only ever takes paths away, which keeps the forks copying on write
+        for (struct memory* space = &memory_root; space; space = space->next) {
+            if (device->read) {
+                space->read_pages[i] = NULL;
+            }
+
+            if (device->write) {
+                space->write_pages[i] = NULL;
+            }
+        }
+
+        memory_remaps++;
+    }
+}
+
+// slow path of read8, taken for pages with a device reading on them
+uint8_t memory_read_fault(uint16_t address) {
+    memory_read_faults++;
+
+    for (struct memory_device* device = memory_devices[address >> 8]; device; device = device->next) {
+        if (device->read && address >= device->start && address <= device->end) {
+            return device->read(address);
+        }
+    }
+
+    uint8_t* page = memory_active->pages[address >> 8];
+    if (!page) {
+        return memory_bus_read(address);
+    }
+
+    return page[address & 0xff];
+}
+
+// slow path of write8, taken for devices, read-only pages
+// and on the first write to a shared page
+void memory_write_fault(uint16_t address, uint8_t value) {
+    uint8_t index = address >> 8;
+    memory_write_faults++;
+
+    for (struct memory_device* device = memory_devices[index]; device; device = device->next) {
+        if (device->write && address >= device->start && address <= device->end) {
+            device->write(address, value);
+            return;
+        }
+    }
+
+    if (!memory_active->pages[index]) {
+        memory_bus_write(address, value);
+        return;
+    }
+
+    if (memory_active->flags[index] & MEMORY_PAGE_READONLY) {
+        return;
+    }
+
+    if (memory_active->flags[index] & MEMORY_PAGE_SHARED) {
+        memory_active->pages[index][address & 0xff] = value;
+        memory_update(memory_active, index);
+        return;
+    }
+
+    struct memory_page* owned = memory_active->owned_pages[index];
+
+    if (!owned || owned->references > 1) {
+        struct memory_page* copy = malloc(sizeof(struct memory_page));
+        if (!copy) {
+            abort();
+        }
+
+        copy->references = 1;
+        memcpy(copy->data, memory_active->pages[index], MEMORY_PAGE_SIZE);
+
+        if (owned) {
+            owned->references--;
+        }
+
+        memory_active->pages[index] = copy->data;
+        memory_active->owned_pages[index] = copy;
+    }
+
+    // either way, every other address space sharing this page is gone
+    memory_update(memory_active, index);
+    memory_active->pages[index][address & 0xff] = value;
+}
+
+// read a byte without going through the cpu bus,
+// pages left to the host bus read as $FF
+uint8_t memory_peek(uint16_t address) {
+    uint8_t* page = memory_active->pages[address >> 8];
+    return page ? page[address & 0xff] : 0xff;
+}
+
+// copy a range of the address space a page at a time, wrapping at $FFFF
+void memory_read_block(uint16_t address, uint8_t* buffer, uint32_t length) {
+    while (length) {
+        uint32_t offset = address & 0xff;
+        uint32_t chunk = MEMORY_PAGE_SIZE - offset < length ? MEMORY_PAGE_SIZE - offset : length;
+        uint8_t* page = memory_active->pages[address >> 8];
+
+        if (page) {
+            memcpy(buffer, page + offset, chunk);
+        } else {
+            memset(buffer, 0xff, chunk);
+        }
+
+        address += chunk;
+        buffer += chunk;
+        length -= chunk;
+    }
+}
+
+// writable pages are copied to directly, the others take the
+// same slow path as the cpu (devices, read-only and shared pages)
+void memory_write_block(uint16_t address, const uint8_t* buffer, uint32_t length) {
+    while (length) {
+        uint32_t offset = address & 0xff;
+        uint32_t chunk = MEMORY_PAGE_SIZE - offset < length ? MEMORY_PAGE_SIZE - offset : length;
+        uint8_t* page = memory_active->write_pages[address >> 8];
+
+        if (page) {
+            memcpy(page + offset, buffer, chunk);
+        } else {
+            for (uint32_t i = 0; i < chunk; i++) {
+                memory_write_fault(address + i, buffer[i]);
+            }
+        }
+
+        address += chunk;
+        buffer += chunk;
+        length -= chunk;
+    }
+}
+
+// load an image into the flat image under the root address space, past
+// the devices and whatever is mapped over it, wrapping at $FFFF. the
+// copies of its pages forked off get the new bytes too. the pages are
+// updated in every address space without giving write access back
+void memory_load(uint16_t address, const uint8_t* buffer, uint32_t length) {
+    while (length) {
+        uint32_t offset = address & 0xff;
+        uint32_t chunk = MEMORY_PAGE_SIZE - offset < length ? MEMORY_PAGE_SIZE - offset : length;
+        uint8_t index = address >> 8;
+
+        memcpy(cpu_memory + address, buffer, chunk);
+
+        for (struct memory* space = &memory_root; space; space = space->next) {
+            struct memory_page* owned = space->owned_pages[index];
+            if (owned) {
+                memcpy(owned->data + offset, buffer, chunk);
+            }
+
+            uint8_t* writable = space->write_pages[index];
+            memory_update(space, index);
+            if (!writable) {
+                space->write_pages[index] = NULL;
+            }
+        }
+
+        address += chunk;
+        buffer += chunk;
+        length -= chunk;
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef CURSES6502_MEMORY_H
+#define CURSES6502_MEMORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MEMORY_PAGE_SIZE 0x100
+#define MEMORY_PAGE_COUNT 0x100
+
+// writes to the page are dropped
+#define MEMORY_PAGE_READONLY (1 << 0)
+// the page lives in storage shared by every address space
+// (banked memory), writes go straight through instead of copying
+#define MEMORY_PAGE_SHARED (1 << 1)
+
+// a memory mapped device. reads and writes to [start, end] are handed
+// to the device instead of memory, a NULL handler leaves them to memory
+struct memory_device {
+    uint16_t start;
+    uint16_t end;
+    uint8_t (*read)(uint16_t address);
+    void (*write)(uint16_t address, uint8_t value);
+    struct memory_device* next;
+};
+
+// a heap allocated page, shared by every address space
+// that was forked while it was mapped
+struct memory_page {
+    uint32_t references;
+    uint8_t data[MEMORY_PAGE_SIZE];
+};
+
+// a 64 KiB address space split into 256 pages of 256 bytes.
+//
+// pages holds the storage behind every page. the cpu reads through
+// read_pages, which is NULL when a device wants to see the reads, and
+// writes through write_pages, which is NULL for devices, read-only pages
+// and pages shared with another address space: the first write to such
+// a page copies it (see memory_write_fault)
+struct memory {
+    uint8_t* pages[MEMORY_PAGE_COUNT];
+    uint8_t* read_pages[MEMORY_PAGE_COUNT];
+    uint8_t* write_pages[MEMORY_PAGE_COUNT];
+
+    // NULL when the page lives in storage the address space doesn't own
+    // (the flat cpu_memory image for the root address space)
+    struct memory_page* owned_pages[MEMORY_PAGE_COUNT];
+
+    uint8_t flags[MEMORY_PAGE_COUNT];
+
+    // the next live address space, the root one heads the list
+    struct memory* next;
+};
+
+// the address space the cpu is currently running on
+extern struct memory* memory_active;
+
+// goes up every time a page of any address space is pointed at other
+// storage, so that page pointers kept aside can be told apart from stale ones
+extern uint64_t memory_remaps;
+
+// the accesses that missed the page pointers of the cpu and took
+// the slow paths, counted for the metrics
+extern uint64_t memory_read_faults;
+extern uint64_t memory_write_faults;
+
+extern uint8_t (*memory_bus_read)(uint16_t address);
+extern void (*memory_bus_write)(uint16_t address, uint8_t value);
+
+void memory_init(void);
+
+struct memory* memory_fork(struct memory* parent);
+void memory_free(struct memory* space);
+
+void memory_map(uint8_t page, uint8_t* data, uint8_t flags);
+void memory_add_device(struct memory_device* device);
+
+uint8_t memory_read_fault(uint16_t address);
+void memory_write_fault(uint16_t address, uint8_t value);
+
+uint8_t memory_peek(uint16_t address);
+
+void memory_read_block(uint16_t address, uint8_t* buffer, uint32_t length);
+void memory_write_block(uint16_t address, const uint8_t* buffer, uint32_t length);
+void memory_load(uint16_t address, const uint8_t* buffer, uint32_t length);
+
+#endif
@@ -0,0 +1,123 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include "cpu.h"
+#include "debugger.h"
+#include "memory.h"
+#include "metrics.h"
+
+// the clock rate is measured over windows of this many ns
+#define METRICS_RATE_WINDOW 250000000
+
+struct metrics_block* metrics_block = NULL;
+
+// where the current clock rate window started
+uint64_t metrics_rate_start = 0;
+uint64_t metrics_rate_cycles = 0;
+
+uint64_t metrics_time(clockid_t clock) {
+    struct timespec now;
+    clock_gettime(clock, &now);
+
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// ns on a clock that only goes forward, for timing frames
+uint64_t metrics_clock(void) {
+    return metrics_time(CLOCK_MONOTONIC);
+}
+
+// create or take over the file, readers opening it
+// before the first update see every counter at 0.
+// return 1 if should abort, 0 otherwise
+int metrics_open(const char* file) {
+    int fd = open(file, O_RDWR | O_CREAT, 0644);
+    if (fd == -1 || ftruncate(fd, sizeof(struct metrics_block))) {
+        fprintf(stderr, "Could not open %s.\n", file);
+
+        if (fd != -1) {
+            close(fd);
+        }
+
+        return 1;
+    }
+
+    void* block = mmap(NULL, sizeof(struct metrics_block), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (block == MAP_FAILED) {
+        fprintf(stderr, "Could not map %s.\n", file);
+        return 1;
+    }
+
+    metrics_block = block;
+
+    // a previous run may have left the sequence anywhere
+    uint32_t sequence = atomic_load_explicit(&metrics_block->sequence, memory_order_relaxed) | 1;
+    atomic_store_explicit(&metrics_block->sequence, sequence, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    metrics_block->magic = METRICS_MAGIC;
+    metrics_block->version = METRICS_VERSION;
+    metrics_block->pid = getpid();
+    metrics_block->count = METRICS_COUNT;
+    for (int i = 0; i < METRICS_COUNT; i++) {
+        atomic_store_explicit(&metrics_block->values[i], 0, memory_order_relaxed);
+    }
+
+    atomic_store_explicit(&metrics_block->sequence, sequence + 1, memory_order_release);
+
+    metrics_rate_start = metrics_clock();
+    metrics_rate_cycles = 0;
+    return 0;
+}
+
+// the file stays behind with the last values, for readers that come late
+void metrics_close(void) {
+    if (metrics_block) {
+        munmap(metrics_block, sizeof(struct metrics_block));
+        metrics_block = NULL;
+    }
+}
+
+// called between time slices with the cycles run since the start and
+// the time the last frame took to draw, 0 without the user interface.
+// the emulation thread is the only writer, so this never waits
+void metrics_publish(uint64_t cycles, uint64_t frame_time) {
+    if (!metrics_block) {
+        return;
+    }
+
+    uint64_t values[METRICS_COUNT];
+    uint64_t now = metrics_clock();
+
+    values[METRICS_HZ] = atomic_load_explicit(&metrics_block->values[METRICS_HZ], memory_order_relaxed);
+    if (now - metrics_rate_start >= METRICS_RATE_WINDOW) {
+        values[METRICS_HZ] = (cycles - metrics_rate_cycles) * 1000000000.0 / (now - metrics_rate_start);
+        metrics_rate_start = now;
+        metrics_rate_cycles = cycles;
+    }
+
+    values[METRICS_UPDATED] = metrics_time(CLOCK_REALTIME);
+    values[METRICS_CYCLES] = cycles;
+    values[METRICS_INSTRUCTIONS] = cpu_instructions;
+    values[METRICS_FRAME_TIME] = frame_time;
+    values[METRICS_IRQS] = cpu_irq_count;
+    values[METRICS_NMIS] = cpu_nmi_count;
+    values[METRICS_BRKS] = cpu_brk_count;
+    values[METRICS_BREAKPOINTS] = debugger_breaks;
+    values[METRICS_READ_FAULTS] = memory_read_faults;
+    values[METRICS_WRITE_FAULTS] = memory_write_faults;
+
+    uint32_t sequence = atomic_load_explicit(&metrics_block->sequence, memory_order_relaxed);
+    atomic_store_explicit(&metrics_block->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    for (int i = 0; i < METRICS_COUNT; i++) {
+        atomic_store_explicit(&metrics_block->values[i], values[i], memory_order_relaxed);
+    }
+
+    atomic_store_explicit(&metrics_block->sequence, sequence + 2, memory_order_release);
+}
@@ -0,0 +1,43 @@
+#ifndef CURSES6502_METRICS_H
+#define CURSES6502_METRICS_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+// a running emulator publishes its counters in a file mapped by every
+// reader, /dev/shm/<name> keeps it in shared memory. the file is only
+// ever written by the emulator, once per time slice, under a sequence
+// lock: the sequence is odd while the values change, so a reader copies
+// them between two reads of the same even sequence and retries otherwise
+#define METRICS_MAGIC 0x32303536 // "6502"
+#define METRICS_VERSION 1
+
+#define METRICS_UPDATED       0 // wall clock time of the last update, in ns since the epoch
+#define METRICS_CYCLES        1
+#define METRICS_INSTRUCTIONS  2
+#define METRICS_HZ            3 // the emulated clock, averaged over the last quarter of a second
+#define METRICS_FRAME_TIME    4 // the ns the user interface took to draw its last frame
+#define METRICS_IRQS          5
+#define METRICS_NMIS          6
+#define METRICS_BRKS          7
+#define METRICS_BREAKPOINTS   8 // the times a breakpoint halted the cpu
+#define METRICS_READ_FAULTS   9 // accesses that missed the page pointers of the cpu
+#define METRICS_WRITE_FAULTS  10
+#define METRICS_COUNT         11
+
+struct metrics_block {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t pid;
+    uint32_t count;
+    _Atomic uint32_t sequence;
+    _Atomic uint64_t values[METRICS_COUNT];
+};
+
+int metrics_open(const char* file);
+void metrics_close(void);
+
+uint64_t metrics_clock(void);
+void metrics_publish(uint64_t cycles, uint64_t frame_time);
+
+#endif
@@ -0,0 +1,74 @@
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include "reload.h"
+
+int reload_inotify = -1;
+char* reload_name = NULL;
+
+// the directory is watched rather than the file: builds usually write
+// a new file and rename it over the old one, which a watch on the old
+// file wouldn't see. return 1 if should abort, 0 otherwise
+int reload_watch(const char* file) {
+    char* path = strdup(file);
+    char* name = strdup(file);
+    char* directory = path ? dirname(path) : NULL;
+
+    reload_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (!directory || !name || reload_inotify == -1 ||
+        inotify_add_watch(reload_inotify, directory, IN_CLOSE_WRITE | IN_MOVED_TO) == -1) {
+        fprintf(stderr, "Could not watch %s.\n", file);
+        free(path);
+        free(name);
+        reload_free();
+        return 1;
+    }
+
+    reload_name = strdup(basename(name));
+    free(path);
+    free(name);
+
+    if (!reload_name) {
+        fprintf(stderr, "Could not watch %s.\n", file);
+        reload_free();
+        return 1;
+    }
+
+    return 0;
+}
+
+// called between time slices, it doesn't block.
+// return 1 if the file was written since the last call, 0 otherwise
+int reload_poll(void) {
+    if (reload_inotify == -1) {
+        return 0;
+    }
+
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int changed = 0;
+    ssize_t length;
+
+    // a build can write the file several times, they all count as one
+    while ((length = read(reload_inotify, events, sizeof(events))) > 0) {
+        for (char* at = events; at < events + length;) {
+            struct inotify_event* event = (struct inotify_event*) at;
+            changed |= event->len && strcmp(event->name, reload_name) == 0;
+            at += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    return changed;
+}
+
+void reload_free(void) {
+    if (reload_inotify != -1) {
+        close(reload_inotify);
+        reload_inotify = -1;
+    }
+
+    free(reload_name);
+    reload_name = NULL;
+}
@@ -0,0 +1,12 @@
+#ifndef CURSES6502_RELOAD_H
+#define CURSES6502_RELOAD_H
+
+// what the cpu does once the binary file was reloaded
+#define RELOAD_CONTINUE 0 // go on from where it is, with the new code under it
+#define RELOAD_RESET    1 // go through the reset vector of the new code
+
+int reload_watch(const char* file);
+int reload_poll(void);
+void reload_free(void);
+
+#endif
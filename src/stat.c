@@ -0,0 +1,140 @@
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "metrics.h"
+
+#define STAT_TRIES 1000000
+
+// prints the counters a running curses6502 publishes with -m, without
+// ever blocking it: the block is only read, retrying while it changes
+
+const char* stat_names[METRICS_COUNT] = {
+        "updated", "cycles", "instructions", "clock", "frame time", "irqs",
+        "nmis", "brks", "breakpoints", "read faults", "write faults",
+};
+
+void print_usage(const char* app_name) {
+    printf("Usage: %s [options] <file>...\n", app_name);
+    printf("Options:\n");
+    printf("  -h                Display this message.\n");
+    printf("  -i <ms>           Print the counters again every interval, until killed.\n");
+}
+
+// copy the values out of the block between two updates. an emulator
+// killed in the middle of an update leaves the sequence odd for good.
+// return 1 if the block wasn't written by this version or never settles, 0 otherwise
+int stat_read(const struct metrics_block* block, uint32_t* pid, uint64_t* values) {
+    for (int tries = 0; tries < STAT_TRIES; tries++) {
+        uint32_t before = atomic_load_explicit(&block->sequence, memory_order_acquire);
+        if (before & 1) {
+            continue;
+        }
+
+        if (block->magic != METRICS_MAGIC || block->version != METRICS_VERSION || block->count != METRICS_COUNT) {
+            return 1;
+        }
+
+        *pid = block->pid;
+        for (int i = 0; i < METRICS_COUNT; i++) {
+            values[i] = atomic_load_explicit(&block->values[i], memory_order_relaxed);
+        }
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&block->sequence, memory_order_relaxed) == before) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// return 1 if the file isn't a counter block, 0 otherwise
+int stat_print(const char* file) {
+    struct stat info;
+    int fd = open(file, O_RDONLY);
+    void* block = MAP_FAILED;
+
+    // mapping past the end of a smaller file would fault on the first read
+    if (fd != -1 && !fstat(fd, &info) && info.st_size >= (off_t) sizeof(struct metrics_block)) {
+        block = mmap(NULL, sizeof(struct metrics_block), PROT_READ, MAP_SHARED, fd, 0);
+    }
+
+    if (fd != -1) {
+        close(fd);
+    }
+
+    if (block == MAP_FAILED) {
+        fprintf(stderr, "Could not open %s.\n", file);
+        return 1;
+    }
+
+    uint32_t pid;
+    uint64_t values[METRICS_COUNT];
+    int failed = stat_read(block, &pid, values);
+    munmap(block, sizeof(struct metrics_block));
+
+    if (failed) {
+        fprintf(stderr, "%s holds no counters this version can read.\n", file);
+        return 1;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    uint64_t age = (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec - values[METRICS_UPDATED];
+
+    printf("%s, pid %u, updated %.3fs ago\n", file, pid, values[METRICS_UPDATED] ? age / 1e9 : 0.0);
+
+    for (int i = METRICS_CYCLES; i < METRICS_COUNT; i++) {
+        if (i == METRICS_HZ) {
+            printf("  %-14s %.3f MHz\n", stat_names[i], values[i] / 1e6);
+        } else if (i == METRICS_FRAME_TIME) {
+            printf("  %-14s %.3f ms\n", stat_names[i], values[i] / 1e6);
+        } else {
+            printf("  %-14s %" PRIu64 "\n", stat_names[i], values[i]);
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    long interval = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "hi:")) != -1) {
+        switch (opt) {
+            case 'i':
+                interval = strtol(optarg, NULL, 0);
+                break;
+
+            case 'h':
+            default:
+                print_usage(argv[0]);
+                return EXIT_SUCCESS;
+        }
+    }
+
+    if (optind == argc) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    for (;;) {
+        int failed = 0;
+        for (int i = optind; i < argc; i++) {
+            failed |= stat_print(argv[i]);
+        }
+
+        if (interval <= 0) {
+            return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+        }
+
+        fflush(stdout);
+        usleep(interval * 1000);
+    }
+}
@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <string.h>
+#include "memory.h"
+#include "viewer.h"
+
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+#ifdef __SSE2__
+__m128i viewer_digits128(__m128i nibbles) {
+    __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9)), _mm_set1_epi8('A' - '0' - 10));
+    return _mm_add_epi8(_mm_add_epi8(nibbles, _mm_set1_epi8('0')), letters);
+}
+#endif
+
+// two uppercase hex digits per byte, without separators
+void viewer_hex(const uint8_t* bytes, size_t length, char* out) {
+    size_t i = 0;
+
+#ifdef __SSE2__
+    for (; i + 16 <= length; i += 16) {
+        __m128i in = _mm_loadu_si128((const __m128i*) (bytes + i));
+        __m128i high = viewer_digits128(_mm_and_si128(_mm_srli_epi16(in, 4), _mm_set1_epi8(0x0f)));
+        __m128i low = viewer_digits128(_mm_and_si128(in, _mm_set1_epi8(0x0f)));
+
+        _mm_storeu_si128((__m128i*) (out + i * 2), _mm_unpacklo_epi8(high, low));
+        _mm_storeu_si128((__m128i*) (out + i * 2 + 16), _mm_unpackhi_epi8(high, low));
+    }
+#endif
+
+    for (; i < length; i++) {
+        out[i * 2] = "0123456789ABCDEF"[bytes[i] >> 4];
+        out[i * 2 + 1] = "0123456789ABCDEF"[bytes[i] & 0x0f];
+    }
+}
+
+// 16 bytes laid out like the memory viewer always did,
+// with an extra space between the two halves
+void viewer_format_row(const uint8_t* bytes, char* out) {
+    char digits[32];
+    viewer_hex(bytes, 16, digits);
+
+    memset(out, ' ', VIEWER_ROW_LENGTH);
+    for (int j = 0; j < 16; j++) {
+        memcpy(out + j * 3 + (j >= 8 ? 1 : 0), digits + j * 2, 2);
+    }
+
+    out[VIEWER_ROW_LENGTH] = '\0';
+}
+
+// one bit per byte that differs from the shadow copy, which is then updated
+uint16_t viewer_changes(const uint8_t* bytes, uint8_t* shadow) {
+#ifdef __SSE2__
+    __m128i current = _mm_loadu_si128((const __m128i*) bytes);
+    __m128i previous = _mm_loadu_si128((const __m128i*) shadow);
+    uint16_t changes = ~_mm_movemask_epi8(_mm_cmpeq_epi8(current, previous));
+
+    _mm_storeu_si128((__m128i*) shadow, current);
+    return changes;
+#else
+    uint16_t changes = 0;
+    for (int j = 0; j < 16; j++) {
+        changes |= (bytes[j] != shadow[j]) << j;
+        shadow[j] = bytes[j];
+    }
+
+    return changes;
+#endif
+}
+
+// take rows as they are into the shadow copy, for rows that just
+// scrolled into view: they would otherwise light up as changed
+void viewer_sync(uint16_t address, int rows, uint8_t* shadow) {
+    for (int i = 0; i < rows; i++, address += 16) {
+        memory_read_block(address, shadow + address, 16);
+    }
+}
+
+// draw the row with a single string, then only touch the attributes
+// of the bytes that changed since the last frame or that attributes
+// wants to stand out
+void viewer_draw_row(WINDOW* window, int line, uint16_t address, uint8_t* shadow, attr_t (*attributes)(uint16_t address)) {
+    uint8_t bytes[16];
+    char row[VIEWER_ROW_LENGTH + 1];
+
+    memory_read_block(address, bytes, 16);
+    viewer_format_row(bytes, row);
+
+    uint16_t changes = viewer_changes(bytes, shadow + address);
+
+    // a narrow window cuts the row off at its border instead of wrapping
+    char text[VIEWER_ROW_LENGTH + 8];
+    int width = getmaxx(window) - 2;
+    snprintf(text, sizeof(text), "%04X:  %s", address, row);
+    mvwaddnstr(window, line, 1, text, width);
+
+    for (int j = 0; j < 16; j++) {
+        int column = j * 3 + 8 + (j >= 8 ? 1 : 0);
+        attr_t attribute = attributes ? attributes(address + j) : A_NORMAL;
+        if ((changes >> j) & 1) {
+            attribute |= A_REVERSE;
+        }
+
+        if (attribute != A_NORMAL && column + 1 <= width) {
+            mvwchgat(window, line, column, 2, attribute, 0, NULL);
+        }
+    }
+}
+
+// hex bytes, spaces between them are optional.
+// return the length of the pattern, 0 if it is not valid
+size_t viewer_parse_pattern(const char* text, uint8_t* pattern) {
+    size_t length = 0;
+    int digits = 0;
+
+    for (; *text; text++) {
+        int value;
+        if (*text >= '0' && *text <= '9') {
+            value = *text - '0';
+        } else if ((*text | 0x20) >= 'a' && (*text | 0x20) <= 'f') {
+            value = (*text | 0x20) - 'a' + 10;
+        } else if (*text == ' ') {
+            continue;
+        } else {
+            return 0;
+        }
+
+        if (length == VIEWER_MAX_PATTERN) {
+            return 0;
+        }
+
+        pattern[length] = digits ? pattern[length] << 4 | value : value;
+        digits = !digits;
+        length += !digits;
+    }
+
+    return digits ? 0 : length;
+}
+
+// find the pattern at or after start, wrapping around the address space.
+// return 1 if found, 0 otherwise
+int viewer_search(const uint8_t* pattern, size_t length, uint16_t start, uint16_t* found) {
+    // the copy is extended so that a match can span $FFFF and $0000
+    static uint8_t image[0x10000 + VIEWER_MAX_PATTERN + 16];
+
+    if (length == 0 || length > VIEWER_MAX_PATTERN) {
+        return 0;
+    }
+
+    memory_read_block(0, image, 0x10000);
+    memcpy(image + 0x10000, image, VIEWER_MAX_PATTERN + 16);
+
+    for (int pass = 0; pass < 2; pass++) {
+        uint32_t from = pass ? 0 : start;
+        uint32_t to = pass ? start : 0x10000;
+        uint32_t i = from;
+
+#ifdef __SSE2__
+        __m128i first = _mm_set1_epi8(pattern[0]);
+
+        for (; i + 16 <= to; i += 16) {
+            uint32_t candidates = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (image + i)), first));
+
+            while (candidates) {
+                uint32_t offset = __builtin_ctz(candidates);
+                if (memcmp(image + i + offset, pattern, length) == 0) {
+                    *found = i + offset;
+                    return 1;
+                }
+
+                candidates &= candidates - 1;
+            }
+        }
+#endif
+
+        for (; i < to; i++) {
+            if (image[i] == pattern[0] && memcmp(image + i, pattern, length) == 0) {
+                *found = i;
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
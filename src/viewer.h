@@ -0,0 +1,24 @@
+#ifndef CURSES6502_VIEWER_H
+#define CURSES6502_VIEWER_H
+
+#include <ncurses.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// "XX XX XX XX XX XX XX XX  XX XX XX XX XX XX XX XX"
+#define VIEWER_ROW_LENGTH 49
+
+#define VIEWER_MAX_PATTERN 32
+
+void viewer_hex(const uint8_t* bytes, size_t length, char* out);
+void viewer_format_row(const uint8_t* bytes, char* out);
+
+uint16_t viewer_changes(const uint8_t* bytes, uint8_t* shadow);
+void viewer_sync(uint16_t address, int rows, uint8_t* shadow);
+
+void viewer_draw_row(WINDOW* window, int line, uint16_t address, uint8_t* shadow, attr_t (*attributes)(uint16_t address));
+
+size_t viewer_parse_pattern(const char* text, uint8_t* pattern);
+int viewer_search(const uint8_t* pattern, size_t length, uint16_t start, uint16_t* found);
+
+#endif
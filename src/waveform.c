@@ -0,0 +1,255 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "cycle.h"
+#include "waveform.h"
+
+struct waveform_sample {
+    uint64_t cycle;
+    uint16_t address;
+    uint8_t data;
+    uint8_t lines;
+};
+
+// filled by the emulation thread and drained by the writer. each side
+// only stores its own index, on cache lines of their own
+struct waveform_sample* waveform_ring = NULL;
+_Alignas(64) atomic_uint_fast64_t waveform_head = 0;
+_Alignas(64) atomic_uint_fast64_t waveform_tail = 0;
+_Alignas(64) uint64_t waveform_free = 0; // room the emulation thread knows of
+
+atomic_int waveform_stopping = 0;
+pthread_t waveform_thread;
+int waveform_output = -1;
+int waveform_failed = 0; // once a write fails, the cycles are only drained
+
+// the text is built here and written in large chunks
+char* waveform_buffer = NULL;
+size_t waveform_length = 0;
+
+// "b" and the 8 bits of every byte, most significant first
+char waveform_bits[256][9];
+
+// the values last written, the first cycle writes them all
+uint16_t waveform_address;
+uint8_t waveform_data;
+uint8_t waveform_lines;
+int waveform_started = 0;
+
+void waveform_sleep(void) {
+    struct timespec pause = {0, 100000};
+    nanosleep(&pause, NULL);
+}
+
+// the bus is never held up for the disk: the emulation
+// thread only waits once the whole ring is waiting for it
+void waveform_probe(uint64_t cycle, uint16_t address, uint8_t data, uint8_t lines) {
+    uint64_t head = atomic_load_explicit(&waveform_head, memory_order_relaxed);
+
+    while (!waveform_free) {
+        uint64_t tail = atomic_load_explicit(&waveform_tail, memory_order_acquire);
+        waveform_free = WAVEFORM_RING_SIZE - (head - tail);
+
+        if (!waveform_free) {
+            waveform_sleep();
+        }
+    }
+
+    struct waveform_sample* sample = &waveform_ring[head & (WAVEFORM_RING_SIZE - 1)];
+    sample->cycle = cycle;
+    sample->address = address;
+    sample->data = data;
+    sample->lines = lines;
+
+    waveform_free--;
+    atomic_store_explicit(&waveform_head, head + 1, memory_order_release);
+}
+
+void waveform_flush(void) {
+    size_t written = 0;
+
+    while (written < waveform_length && !waveform_failed) {
+        ssize_t result = write(waveform_output, waveform_buffer + written, waveform_length - written);
+        if (result == -1 && errno == EINTR) {
+            continue;
+        }
+
+        // anything else ends the recording where the file stands
+        if (result <= 0) {
+            fprintf(stderr, "Could not write the waveform, recording stopped: %s.\n",
+                    result ? strerror(errno) : "nothing written");
+            waveform_failed = 1;
+            break;
+        }
+
+        written += result;
+    }
+
+    waveform_length = 0;
+}
+
+void waveform_append(const char* text, size_t length) {
+    memcpy(waveform_buffer + waveform_length, text, length);
+    waveform_length += length;
+}
+
+// a timestamp line, #<cycle>
+void waveform_append_cycle(uint64_t cycle) {
+    char digits[24];
+    int count = 0;
+
+    do {
+        digits[sizeof(digits) - ++count] = '0' + cycle % 10;
+        cycle /= 10;
+    } while (cycle);
+
+    waveform_buffer[waveform_length++] = '#';
+    waveform_append(digits + sizeof(digits) - count, count);
+    waveform_buffer[waveform_length++] = '\n';
+}
+
+// the longest a cycle can take: its timestamp and all four signals
+#define WAVEFORM_MAX_CYCLE_LENGTH 96
+
+void waveform_append_sample(const struct waveform_sample* sample) {
+    uint8_t changed = sample->lines ^ waveform_lines;
+
+    if (waveform_started && sample->address == waveform_address && sample->data == waveform_data && !changed) {
+        return;
+    }
+
+    waveform_append_cycle(sample->cycle);
+
+    if (!waveform_started || sample->address != waveform_address) {
+        waveform_append(waveform_bits[sample->address >> 8], 9);
+        waveform_append(waveform_bits[sample->address & 0xff] + 1, 8);
+        waveform_append(" a\n", 3);
+    }
+
+    if (!waveform_started || sample->data != waveform_data) {
+        waveform_append(waveform_bits[sample->data], 9);
+        waveform_append(" d\n", 3);
+    }
+
+    if (!waveform_started || changed & CYCLE_LINE_READ) {
+        waveform_append(sample->lines & CYCLE_LINE_READ ? "1r\n" : "0r\n", 3);
+    }
+
+    if (!waveform_started || changed & CYCLE_LINE_SYNC) {
+        waveform_append(sample->lines & CYCLE_LINE_SYNC ? "1s\n" : "0s\n", 3);
+    }
+
+    waveform_started = 1;
+    waveform_address = sample->address;
+    waveform_data = sample->data;
+    waveform_lines = sample->lines;
+}
+
+void* waveform_run(void* argument) {
+    uint64_t tail = 0;
+
+    for (;;) {
+        // everything queued before the stop request is written out
+        int stopping = atomic_load_explicit(&waveform_stopping, memory_order_acquire);
+        uint64_t head = atomic_load_explicit(&waveform_head, memory_order_acquire);
+
+        if (tail == head) {
+            if (stopping) {
+                break;
+            }
+
+            waveform_sleep();
+            continue;
+        }
+
+        // after a failed write the emulation thread still mustn't wait
+        if (waveform_failed) {
+            tail = head;
+        }
+
+        while (tail != head) {
+            waveform_append_sample(&waveform_ring[tail & (WAVEFORM_RING_SIZE - 1)]);
+            tail++;
+
+            if (waveform_length > WAVEFORM_BUFFER_SIZE - WAVEFORM_MAX_CYCLE_LENGTH) {
+                atomic_store_explicit(&waveform_tail, tail, memory_order_release);
+                waveform_flush();
+            }
+        }
+
+        atomic_store_explicit(&waveform_tail, tail, memory_order_release);
+    }
+
+    waveform_flush();
+    return NULL;
+}
+
+// return 1 if should abort, 0 otherwise
+int waveform_start(const char* file) {
+    waveform_output = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (waveform_output == -1) {
+        fprintf(stderr, "Could not open %s.\n", file);
+        return 1;
+    }
+
+    waveform_ring = malloc(WAVEFORM_RING_SIZE * sizeof(struct waveform_sample));
+    waveform_buffer = malloc(WAVEFORM_BUFFER_SIZE);
+    if (!waveform_ring || !waveform_buffer) {
+        fprintf(stderr, "Could not allocate the waveform buffers.\n");
+        waveform_stop();
+        return 1;
+    }
+
+    for (int i = 0; i < 256; i++) {
+        waveform_bits[i][0] = 'b';
+        for (int bit = 0; bit < 8; bit++) {
+            waveform_bits[i][bit + 1] = (i >> (7 - bit)) & 1 ? '1' : '0';
+        }
+    }
+
+    const char* header = "$version curses6502 $end\n"
+                         "$comment one time unit per cpu cycle $end\n"
+                         "$timescale 1 us $end\n"
+                         "$scope module cpu $end\n"
+                         "$var wire 16 a address $end\n"
+                         "$var wire 8 d data $end\n"
+                         "$var wire 1 r rw $end\n"
+                         "$var wire 1 s sync $end\n"
+                         "$upscope $end\n"
+                         "$enddefinitions $end\n";
+    waveform_append(header, strlen(header));
+
+    if (pthread_create(&waveform_thread, NULL, waveform_run, NULL)) {
+        fprintf(stderr, "Could not start the waveform writer.\n");
+        waveform_stop();
+        return 1;
+    }
+
+    cycle_probe = waveform_probe;
+    return 0;
+}
+
+// write out the cycles still queued and close the file
+void waveform_stop(void) {
+    if (cycle_probe == waveform_probe) {
+        cycle_probe = NULL;
+        atomic_store_explicit(&waveform_stopping, 1, memory_order_release);
+        pthread_join(waveform_thread, NULL);
+    }
+
+    if (waveform_output != -1) {
+        close(waveform_output);
+        waveform_output = -1;
+    }
+
+    free(waveform_ring);
+    free(waveform_buffer);
+    waveform_ring = NULL;
+    waveform_buffer = NULL;
+}
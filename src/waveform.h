@@ -0,0 +1,17 @@
+#ifndef CURSES6502_WAVEFORM_H
+#define CURSES6502_WAVEFORM_H
+
+#include <stdint.h>
+
+// records the address bus, the data bus, R/W and SYNC of every cycle of
+// the cycle-exact core as a VCD file, one time unit per cycle. the
+// emulation thread only queues the cycles, a thread of its own writes them.
+// the fast core has no bus cycles to give, so it needs -E, and -V and
+// -w are done before it starts
+#define WAVEFORM_RING_SIZE (1 << 20) // cycles, a power of two
+#define WAVEFORM_BUFFER_SIZE (1 << 20)
+
+int waveform_start(const char* file);
+void waveform_stop(void);
+
+#endif
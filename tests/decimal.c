@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "batch.h"
+#include "cpu.h"
+#include "memory.h"
+
+// runs ADC and SBC with the decimal flag set over many operands, once
+// in the batch and once per operand on the fast core, and checks that
+// the two agree on the results and the flags. the batch steps the lanes
+// together, so this is what keeps its vector arithmetic honest
+
+#define DECIMAL_ORIGIN  0x0400
+#define DECIMAL_INPUT   0x10 // the two operands and the carry in
+#define DECIMAL_OUTPUT  0x20
+#define DECIMAL_RESULTS 12
+#define DECIMAL_LANES   1000
+#define DECIMAL_CYCLES  400
+
+uint8_t image[0x10000];
+uint8_t batched[DECIMAL_LANES][DECIMAL_RESULTS];
+uint32_t decimal_seed = 0x6502;
+
+uint8_t decimal_random(void) {
+    decimal_seed ^= decimal_seed << 13;
+    decimal_seed ^= decimal_seed >> 17;
+    decimal_seed ^= decimal_seed << 5;
+    return decimal_seed >> 8;
+}
+
+void decimal_put(uint16_t* address, int length, const uint8_t* bytes) {
+    memcpy(image + *address, bytes, length);
+    *address += length;
+}
+
+// the op, then A and the flags through PHP and PLA to the next two result bytes
+void decimal_emit(uint16_t* address, uint8_t* output, int length, const uint8_t* op) {
+    decimal_put(address, length, op);
+    decimal_put(address, 6, (uint8_t[]) {0x85, *output, 0x08, 0x68, 0x85, *output + 1});
+    *output += 2;
+}
+
+// the operands of a lane: two bytes, mostly valid bcd, and the carry
+void decimal_input(int lane, uint8_t* input) {
+    for (int i = 0; i < 2; i++) {
+        uint8_t value = decimal_random();
+        input[i] = lane % 4 ? value % 10 | (value / 10 % 10) << 4 : value;
+    }
+
+    input[2] = decimal_random() & 1;
+}
+
+void decimal_program(void) {
+    uint16_t address = DECIMAL_ORIGIN;
+    uint8_t output = DECIMAL_OUTPUT;
+
+    // SED, LDX the carry in, then every op starts from it and the first operand
+    decimal_put(&address, 3, (uint8_t[]) {0xf8, 0xa6, DECIMAL_INPUT + 2});
+
+    const uint8_t prefix[] = {0xe0, 0x01, 0xa5, DECIMAL_INPUT}; // CPX #1, LDA first
+    uint8_t ops[][3] = {
+            {0x65, DECIMAL_INPUT + 1},       // ADC zp
+            {0xe5, DECIMAL_INPUT + 1},       // SBC zp
+            {0x69, 0x99},                    // ADC #
+            {0xe9, 0x01},                    // SBC #
+            {0x6d, DECIMAL_INPUT + 1, 0x00}, // ADC abs
+            {0xed, DECIMAL_INPUT + 1, 0x00}, // SBC abs
+    };
+    int lengths[] = {2, 2, 2, 2, 3, 3};
+
+    for (int i = 0; i < 6; i++) {
+        decimal_put(&address, sizeof(prefix), prefix);
+        decimal_emit(&address, &output, lengths[i], ops[i]);
+    }
+
+    decimal_put(&address, 3, (uint8_t[]) {0x4c, address & 0xff, address >> 8}); // JMP *
+
+    image[0xfffc] = DECIMAL_ORIGIN & 0xff;
+    image[0xfffd] = DECIMAL_ORIGIN >> 8;
+}
+
+int main(void) {
+    decimal_program();
+
+    memory_init();
+    memory_write_block(0, image, sizeof(image));
+    cpu_reset();
+
+    struct cpu_state state;
+    cpu_save(&state);
+
+    struct batch* batch = batch_create(DECIMAL_LANES);
+    if (!batch) {
+        fprintf(stderr, "Could not allocate the machines.\n");
+        return EXIT_FAILURE;
+    }
+
+    uint8_t inputs[DECIMAL_LANES][3];
+    for (int lane = 0; lane < DECIMAL_LANES; lane++) {
+        decimal_input(lane, inputs[lane]);
+        batch_write(batch, lane, DECIMAL_INPUT, inputs[lane], 3);
+    }
+
+    batch_run(batch, DECIMAL_CYCLES);
+
+    for (int lane = 0; lane < DECIMAL_LANES; lane++) {
+        batch_read(batch, lane, DECIMAL_OUTPUT, batched[lane], DECIMAL_RESULTS);
+    }
+
+    batch_free(batch);
+
+    int failed = 0;
+    for (int lane = 0; lane < DECIMAL_LANES && !failed; lane++) {
+        uint8_t results[DECIMAL_RESULTS];
+        uint64_t cycles = DECIMAL_CYCLES;
+
+        memory_write_block(0, image, sizeof(image));
+        memory_write_block(DECIMAL_INPUT, inputs[lane], 3);
+        cpu_load(&state);
+        cpu_run(&cycles, 0, -1);
+        memory_read_block(DECIMAL_OUTPUT, results, DECIMAL_RESULTS);
+
+        for (int i = 0; i < DECIMAL_RESULTS; i++) {
+            if (results[i] != batched[lane][i]) {
+                fprintf(stderr, "Operands $%02X $%02X, carry %d: the fast core stored $%02X at $%02X, the batch $%02X.\n",
+                        inputs[lane][0], inputs[lane][1], inputs[lane][2], results[i], DECIMAL_OUTPUT + i,
+                        batched[lane][i]);
+                failed = 1;
+                break;
+            }
+        }
+    }
+
+    if (!failed) {
+        printf("The batch and the fast core agree on %d machines.\n", DECIMAL_LANES);
+    }
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
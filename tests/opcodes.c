@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "cpu.h"
+
+// writes a 32K rom for $8000 that goes through every NMOS opcode but the
+// halting ones, many times over, with random operands. ctest runs it with
+// -V to check that the two cores agree on it. the rom is meant to be
+// mapped read only: the random writes can't reach the code
+
+#define OPCODES_ORIGIN  0x8000
+#define OPCODES_POINTER 0xf000 // the zero page it starts with
+#define OPCODES_HANDLER 0xf100 // the irq and nmi handler, RTI
+#define OPCODES_RETURN  0xf101 // what JSR calls, RTS
+#define OPCODES_TARGETS 0xf200 // where each JMP (ind) goes
+#define OPCODES_END     0xfff0
+
+uint8_t rom[0x8000];
+uint32_t opcodes_seed = 0x6502;
+
+uint8_t opcodes_random(void) {
+    opcodes_seed ^= opcodes_seed << 13;
+    opcodes_seed ^= opcodes_seed >> 17;
+    opcodes_seed ^= opcodes_seed << 5;
+    return opcodes_seed >> 8;
+}
+
+void opcodes_put(uint16_t* address, uint8_t value) {
+    rom[(*address)++ - OPCODES_ORIGIN] = value;
+}
+
+void opcodes_put_word(uint16_t* address, uint16_t value) {
+    opcodes_put(address, value & 0xff);
+    opcodes_put(address, value >> 8);
+}
+
+// mostly the ram below $0800, now and then anywhere
+uint16_t opcodes_random_address(void) {
+    uint8_t high = opcodes_random();
+    return (opcodes_random() & 7 ? high & 7 : high) << 8 | opcodes_random();
+}
+
+// return 1 if the opcode can't be placed, 0 otherwise
+int opcodes_emit(uint16_t* address, uint16_t* target, uint8_t opcode) {
+    uint8_t flow = cpu_flow(opcode);
+
+    // BRK and the handler's RTI are the only returns that come back
+    if (flow == FLOW_RETURN && opcode != 0x00) {
+        return 1;
+    }
+
+    opcodes_put(address, opcode);
+
+    if (opcode == 0x00) {
+        opcodes_put(address, opcodes_random());
+    } else if (flow == FLOW_BRANCH) {
+        opcodes_put(address, 0);
+    } else if (flow == FLOW_CALL) {
+        opcodes_put_word(address, OPCODES_RETURN);
+    } else if (flow == FLOW_JUMP && cpu_mode(opcode) == ADDR_IND) {
+        opcodes_put_word(address, *target);
+        uint16_t next = *address;
+        opcodes_put_word(target, next);
+    } else if (flow == FLOW_JUMP) {
+        opcodes_put_word(address, *address + 2);
+    } else {
+        switch (cpu_mode(opcode)) {
+            case ADDR_IMM:
+            case ADDR_ZP:
+            case ADDR_ZPX:
+            case ADDR_ZPY:
+            case ADDR_INDX:
+            case ADDR_INDY:
+                opcodes_put(address, opcodes_random());
+                break;
+
+            case ADDR_ABSO:
+            case ADDR_ABSX:
+            case ADDR_ABSY:
+                opcodes_put_word(address, opcodes_random_address());
+                break;
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        printf("Usage: %s <file>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    uint16_t address = OPCODES_ORIGIN;
+    uint16_t target = OPCODES_TARGETS;
+
+    // LDX #$FF, TXS, CLD, then copy the zero page in
+    opcodes_put(&address, 0xa2);
+    opcodes_put(&address, 0xff);
+    opcodes_put(&address, 0x9a);
+    opcodes_put(&address, 0xd8);
+    opcodes_put(&address, 0xe8); // INX, from $FF to 0
+    opcodes_put(&address, 0xbd); // LDA $F000,X
+    opcodes_put_word(&address, OPCODES_POINTER);
+    opcodes_put(&address, 0x95); // STA $00,X
+    opcodes_put(&address, 0x00);
+    opcodes_put(&address, 0xe8); // INX
+    opcodes_put(&address, 0xd0); // BNE
+    opcodes_put(&address, 0xf8);
+
+    // the opcodes go round in order, the operands are what varies
+    for (int opcode = 0; address < OPCODES_POINTER - 6; opcode = (opcode + 1) & 0xff) {
+        opcodes_emit(&address, &target, opcode);
+    }
+
+    opcodes_put(&address, 0x4c); // JMP $8000
+    opcodes_put_word(&address, OPCODES_ORIGIN);
+
+    // pointers into the ram below $0800 for the indirect modes
+    address = OPCODES_POINTER;
+    for (int i = 0; i < 128; i++) {
+        opcodes_put_word(&address, (opcodes_random() & 7) << 8 | opcodes_random());
+    }
+
+    address = OPCODES_HANDLER;
+    opcodes_put(&address, 0x40); // RTI
+    opcodes_put(&address, 0x60); // RTS
+
+    address = 0xfffa;
+    opcodes_put_word(&address, OPCODES_HANDLER);
+    opcodes_put_word(&address, OPCODES_ORIGIN);
+    opcodes_put_word(&address, OPCODES_HANDLER);
+
+    FILE* file = fopen(argv[1], "wb");
+    if (!file || fwrite(rom, sizeof(rom), 1, file) != 1) {
+        fprintf(stderr, "Could not write %s.\n", argv[1]);
+        if (file) {
+            fclose(file);
+        }
+        return EXIT_FAILURE;
+    }
+
+    fclose(file);
+    return EXIT_SUCCESS;
+}